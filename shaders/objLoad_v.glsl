@@ -2,7 +2,7 @@
 
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 normals;
-layout (location = 0) in vec3 texCoords;
+layout (location = 2) in vec2 texCoords;
 uniform mat4 mvp;
 
 void main() {
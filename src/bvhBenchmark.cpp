@@ -0,0 +1,151 @@
+#include "helpers/benchmark.hpp"
+#include "helpers/bvh.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <objLoader/OBJ_Loader.h>
+#include <random>
+#include <thread>
+#include <vector>
+using namespace std;
+
+const int RAYS = 1 << 20;
+const int SWEEPS = 1 << 18;
+
+// Wavy grid of side x side quads, 2 * side^2 triangles.
+void generateGrid(int side, vector<objl::Vertex> &vertices,
+                  vector<unsigned int> &indices) {
+  vertices.resize(size_t(side + 1) * (side + 1));
+  for (int z = 0; z <= side; z++) {
+    for (int x = 0; x <= side; x++) {
+      const glm::vec3 p = bench::gridPosition(side, x, z);
+      vertices[z * (side + 1) + x].Position = objl::Vector3(p.x, p.y, p.z);
+    }
+  }
+  indices = bench::gridIndices(side);
+}
+
+// Center and radius of a sphere around every vertex.
+void boundingSphere(const vector<objl::Vertex> &vertices, glm::vec3 &center,
+                    float &radius) {
+  glm::vec3 boundsMin(INFINITY), boundsMax(-INFINITY);
+  for (const auto &vertex : vertices) {
+    const glm::vec3 p(vertex.Position.X, vertex.Position.Y, vertex.Position.Z);
+    boundsMin = glm::min(boundsMin, p);
+    boundsMax = glm::max(boundsMax, p);
+  }
+  center = (boundsMin + boundsMax) * 0.5f;
+  radius = 0.0f;
+  for (const auto &vertex : vertices) {
+    const glm::vec3 p(vertex.Position.X, vertex.Position.Y, vertex.Position.Z);
+    radius = max(radius, glm::length(p - center));
+  }
+}
+
+// Rays from a sphere around the mesh towards random points near its center.
+vector<bvh::Ray> generateRays(int count, const glm::vec3 &center,
+                              float meshRadius) {
+  mt19937 rng(42);
+  normal_distribution<float> gaussian;
+  uniform_real_distribution<float> uniform(-0.5f, 0.5f);
+  vector<bvh::Ray> rays(count);
+  for (auto &ray : rays) {
+    const glm::vec3 onSphere = glm::normalize(
+        glm::vec3(gaussian(rng), gaussian(rng), gaussian(rng)));
+    const glm::vec3 offset(uniform(rng), uniform(rng), uniform(rng));
+    const glm::vec3 target = center + offset * meshRadius;
+    ray.origin = center + onSphere * meshRadius * 1.5f;
+    ray.direction = glm::normalize(target - ray.origin);
+  }
+  return rays;
+}
+
+double raysPerSecond(const bvh::BVH &tree, const vector<bvh::Ray> &rays,
+                     unsigned int threads, size_t &hits) {
+  vector<size_t> threadHits(threads, 0);
+  vector<thread> workers;
+  const auto start = chrono::steady_clock::now();
+  for (unsigned int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      size_t count = 0;
+      for (size_t i = t; i < rays.size(); i += threads) {
+        bvh::Hit hit;
+        count += tree.intersect(rays[i], hit);
+      }
+      threadHits[t] = count;
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  const double elapsed = bench::seconds(start);
+  hits = 0;
+  for (size_t h : threadHits) {
+    hits += h;
+  }
+  return rays.size() / elapsed;
+}
+
+// Rays and sweeps start 1.5 times the mesh radius away from its center.
+void benchmark(const string &name, const vector<objl::Vertex> &vertices,
+               const vector<unsigned int> &indices) {
+  bvh::BVH tree;
+  tree.addMesh(vertices, indices, glm::mat4(1.0f), 0);
+
+  auto start = chrono::steady_clock::now();
+  tree.build(false);
+  const double serialBuild = bench::seconds(start);
+
+  tree.clear();
+  tree.addMesh(vertices, indices, glm::mat4(1.0f), 0);
+  start = chrono::steady_clock::now();
+  tree.build(true);
+  const double parallelBuild = bench::seconds(start);
+
+  glm::vec3 center;
+  float radius;
+  boundingSphere(vertices, center, radius);
+  const auto rays = generateRays(RAYS, center, radius);
+  const unsigned int cores = max(1u, thread::hardware_concurrency());
+  size_t hits;
+  const double single = raysPerSecond(tree, rays, 1, hits);
+  const double multi = raysPerSecond(tree, rays, cores, hits);
+
+  size_t contacts = 0;
+  start = chrono::steady_clock::now();
+  for (int i = 0; i < SWEEPS; i++) {
+    const bvh::Ray &ray = rays[i];
+    bvh::Hit hit;
+    contacts += tree.sweepSphere(
+        ray.origin, ray.origin + ray.direction * radius * 3.0f, radius * 0.01f,
+        hit);
+  }
+  const double sweeps = SWEEPS / bench::seconds(start);
+
+  cout << name << ": " << tree.triangleCount() << " triangles, "
+       << tree.nodeCount() << " nodes\n"
+       << "  build: " << serialBuild * 1000.0 << " ms serial, "
+       << parallelBuild * 1000.0 << " ms parallel\n"
+       << "  rays: " << single / 1e6 << " M/s on 1 thread, " << multi / 1e6
+       << " M/s on " << cores << " threads (" << hits << " of " << RAYS
+       << " hit)\n"
+       << "  sphere sweeps: " << sweeps / 1e6 << " M/s (" << contacts << " of "
+       << SWEEPS << " touch)\n";
+}
+
+int main() {
+  objl::Loader loader;
+  if (!loader.LoadFile("objects/sphere.obj")) {
+    cout << "Failed to load file" << endl;
+    return 1;
+  }
+  benchmark("sphere.obj", loader.LoadedVertices, loader.LoadedIndices);
+
+  vector<objl::Vertex> vertices;
+  vector<unsigned int> indices;
+  for (int side : {362, 724, 1448}) {
+    generateGrid(side, vertices, indices);
+    benchmark("grid " + to_string(side) + "x" + to_string(side), vertices,
+              indices);
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <vector>
+using namespace std;
+
+// Shared by the benchmark executables.
+namespace bench {
+
+inline double seconds(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Wavy grid of side x side quads over -50..50 on X and Z. Vertex (x, z) is
+// number x + z * (side + 1).
+inline glm::vec3 gridPosition(int side, int x, int z) {
+  const float u = float(x) / side, v = float(z) / side;
+  return glm::vec3(u * 100.0f - 50.0f, 3.0f * sin(u * 40.0f) * cos(v * 30.0f),
+                   v * 100.0f - 50.0f);
+}
+
+// 2 * side^2 triangles over the grid vertices.
+inline vector<unsigned int> gridIndices(int side) {
+  vector<unsigned int> indices;
+  indices.reserve(size_t(side) * side * 6);
+  for (int z = 0; z < side; z++) {
+    for (int x = 0; x < side; x++) {
+      const unsigned int v00 = z * (side + 1) + x, v10 = v00 + 1;
+      const unsigned int v01 = v00 + side + 1, v11 = v01 + 1;
+      indices.insert(indices.end(), {v00, v01, v11, v00, v11, v10});
+    }
+  }
+  return indices;
+}
+
+} // namespace bench
@@ -0,0 +1,590 @@
+#include "bvh.hpp"
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
+
+namespace bvh {
+
+static_assert(sizeof(glm::vec3) == 12, "Nodes are expected to be 32 bytes");
+
+namespace {
+
+const int BINS = 16;
+const unsigned int MAX_LEAF_SIZE = 8;
+const int MAX_DEPTH = 60;
+// Subtrees with more triangles than this get their own thread, as long as
+// there is a core left for it.
+const unsigned int PARALLEL_THRESHOLD = 32 * 1024;
+
+struct Bounds {
+  glm::vec3 min = glm::vec3(INFINITY);
+  glm::vec3 max = glm::vec3(-INFINITY);
+
+  void grow(const glm::vec3 &p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+  void grow(const Bounds &b) {
+    min = glm::min(min, b.min);
+    max = glm::max(max, b.max);
+  }
+  float area() const {
+    const glm::vec3 e = max - min;
+    return e.x < 0.0f ? 0.0f : 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+  }
+};
+
+// Entry distance of a ray into a box, INFINITY if it misses before tMax.
+inline float slab(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+                  const glm::vec3 &origin, const glm::vec3 &invDirection,
+                  float tMax) {
+  const glm::vec3 t0 = (boundsMin - origin) * invDirection;
+  const glm::vec3 t1 = (boundsMax - origin) * invDirection;
+  const glm::vec3 tSmall = glm::min(t0, t1);
+  const glm::vec3 tBig = glm::max(t0, t1);
+  const float tEnter = max(max(tSmall.x, tSmall.y), max(tSmall.z, 0.0f));
+  const float tExit = min(min(tBig.x, tBig.y), min(tBig.z, tMax));
+  return tEnter <= tExit ? tEnter : INFINITY;
+}
+
+// Möller-Trumbore, double sided.
+inline float intersectTriangle(const glm::vec3 &origin,
+                               const glm::vec3 &direction, const glm::vec3 &v0,
+                               const glm::vec3 &v1, const glm::vec3 &v2) {
+  const glm::vec3 e1 = v1 - v0;
+  const glm::vec3 e2 = v2 - v0;
+  const glm::vec3 p = glm::cross(direction, e2);
+  const float det = glm::dot(e1, p);
+  if (fabs(det) < 1e-12f) {
+    return INFINITY;
+  }
+  const float invDet = 1.0f / det;
+  const glm::vec3 s = origin - v0;
+  const float u = glm::dot(s, p) * invDet;
+  if (u < 0.0f || u > 1.0f) {
+    return INFINITY;
+  }
+  const glm::vec3 q = glm::cross(s, e1);
+  const float v = glm::dot(direction, q) * invDet;
+  if (v < 0.0f || u + v > 1.0f) {
+    return INFINITY;
+  }
+  const float t = glm::dot(e2, q) * invDet;
+  return t > 1e-6f ? t : INFINITY;
+}
+
+// Smallest root of a*t^2 + b*t + c = 0 in [0, tMax). The polynomial has the
+// sign of `a` while the sphere is clear of the feature, so a sphere that
+// already overlaps it at t = 0 touches right away if it moves deeper and not
+// at all if it moves out.
+inline bool lowestRoot(float a, float b, float c, float tMax, float &root) {
+  if (fabs(a) < 1e-12f) {
+    return false;
+  }
+  if (c / a < 0.0f) {
+    if (b / a < 0.0f && tMax > 0.0f) {
+      root = 0.0f;
+      return true;
+    }
+    return false;
+  }
+  const float det = b * b - 4.0f * a * c;
+  if (det < 0.0f) {
+    return false;
+  }
+  // Both roots have the same sign, the smaller one is the first contact.
+  const float sqrtDet = sqrt(det);
+  const float root1 = (-b - sqrtDet) / (2.0f * a);
+  const float root2 = (-b + sqrtDet) / (2.0f * a);
+  const float first = min(root1, root2);
+  if (first >= 0.0f && first < tMax) {
+    root = first;
+    return true;
+  }
+  return false;
+}
+
+inline bool insideTriangle(const glm::vec3 &p, const glm::vec3 &v0,
+                           const glm::vec3 &v1, const glm::vec3 &v2,
+                           const glm::vec3 &normal) {
+  return glm::dot(glm::cross(v1 - v0, p - v0), normal) >= 0.0f &&
+         glm::dot(glm::cross(v2 - v1, p - v1), normal) >= 0.0f &&
+         glm::dot(glm::cross(v0 - v2, p - v2), normal) >= 0.0f;
+}
+
+// First contact of a sphere at `center` moving by `move` against a triangle,
+// following Fauerby's "Improved Collision detection and Response". Only
+// approaching contacts count, so a sphere that starts touching can move away.
+float sweepTriangle(const glm::vec3 &center, const glm::vec3 &move,
+                    float radius, const glm::vec3 &v0, const glm::vec3 &v1,
+                    const glm::vec3 &v2, float tMax, glm::vec3 &contact) {
+  glm::vec3 normal = glm::cross(v1 - v0, v2 - v0);
+  const float normalLength = glm::length(normal);
+  if (normalLength < 1e-12f) {
+    return INFINITY;
+  }
+  normal /= normalLength;
+  const glm::vec3 faceNormal = normal;
+  float distance = glm::dot(center - v0, normal);
+  if (distance < 0.0f) {
+    normal = -normal;
+    distance = -distance;
+  }
+
+  // Moving along the plane or away from it, the face itself cannot be hit.
+  // A sphere embedded in the plane can still run into edges and vertices.
+  const float approach = glm::dot(normal, move);
+  if (approach >= -1e-9f) {
+    if (distance >= radius) {
+      return INFINITY;
+    }
+  } else {
+    const float tPlane = max(0.0f, (radius - distance) / approach);
+    if (tPlane >= tMax) {
+      return INFINITY;
+    }
+
+    // Touching the inside of the face always comes before edges and vertices.
+    const glm::vec3 atPlane = center + move * tPlane;
+    const glm::vec3 projected =
+        atPlane - normal * glm::dot(atPlane - v0, normal);
+    if (insideTriangle(projected, v0, v1, v2, faceNormal)) {
+      contact = projected;
+      return tPlane;
+    }
+  }
+
+  float best = tMax, t;
+  bool found = false;
+  const float moveSq = glm::dot(move, move);
+  const glm::vec3 vertices[3] = {v0, v1, v2};
+  for (int i = 0; i < 3; i++) {
+    const glm::vec3 &v = vertices[i];
+    const float b = 2.0f * glm::dot(move, center - v);
+    const float c = glm::dot(center - v, center - v) - radius * radius;
+    if (lowestRoot(moveSq, b, c, best, t)) {
+      best = t;
+      contact = v;
+      found = true;
+    }
+  }
+
+  for (int i = 0; i < 3; i++) {
+    const glm::vec3 &a = vertices[i];
+    const glm::vec3 edge = vertices[(i + 1) % 3] - a;
+    const glm::vec3 base = a - center;
+    const float edgeSq = glm::dot(edge, edge);
+    const float edgeDotMove = glm::dot(edge, move);
+    const float edgeDotBase = glm::dot(edge, base);
+    const float qa = edgeSq * -moveSq + edgeDotMove * edgeDotMove;
+    const float qb = edgeSq * 2.0f * glm::dot(move, base) -
+                     2.0f * edgeDotMove * edgeDotBase;
+    const float qc = edgeSq * (radius * radius - glm::dot(base, base)) +
+                     edgeDotBase * edgeDotBase;
+    if (lowestRoot(qa, qb, qc, best, t)) {
+      const float f = (edgeDotMove * t - edgeDotBase) / edgeSq;
+      if (f >= 0.0f && f <= 1.0f) {
+        best = t;
+        contact = a + edge * f;
+        found = true;
+      }
+    }
+  }
+  return found ? best : INFINITY;
+}
+
+} // namespace
+
+struct BVH::Builder {
+  vector<Bounds> bounds;
+  vector<glm::vec3> centroids;
+  vector<unsigned int> refs;
+  vector<Node> nodes;
+  atomic<unsigned int> used;
+  // Threads that may still be started besides the calling one.
+  atomic<int> spareThreads;
+
+  Builder(bool parallel)
+      : used(1),
+        spareThreads(parallel ? int(thread::hardware_concurrency()) - 1 : 0) {}
+
+  bool takeThread() {
+    if (spareThreads.fetch_sub(1) > 0) {
+      return true;
+    }
+    spareThreads.fetch_add(1);
+    return false;
+  }
+
+  void makeLeaf(Node &node, unsigned int first, unsigned int count) {
+    node.first = first;
+    node.count = count;
+  }
+
+  void subdivide(unsigned int index, unsigned int first, unsigned int count,
+                 int depth) {
+    Node &node = nodes[index];
+    Bounds box, centroidBox;
+    for (unsigned int i = first; i < first + count; i++) {
+      box.grow(bounds[refs[i]]);
+      centroidBox.grow(centroids[refs[i]]);
+    }
+    node.boundsMin = box.min;
+    node.boundsMax = box.max;
+
+    if (count <= 2 || depth >= MAX_DEPTH) {
+      makeLeaf(node, first, count);
+      return;
+    }
+
+    // Binned SAH over the three axes.
+    int bestAxis = -1, bestSplit = 0;
+    float bestCost = INFINITY;
+    const glm::vec3 extent = centroidBox.max - centroidBox.min;
+    for (int axis = 0; axis < 3; axis++) {
+      if (extent[axis] <= 0.0f) {
+        continue;
+      }
+      Bounds binBounds[BINS];
+      unsigned int binCount[BINS] = {};
+      const float scale = BINS / extent[axis];
+      for (unsigned int i = first; i < first + count; i++) {
+        const unsigned int ref = refs[i];
+        const int bin = min(
+            BINS - 1, int((centroids[ref][axis] - centroidBox.min[axis]) * scale));
+        binBounds[bin].grow(bounds[ref]);
+        binCount[bin]++;
+      }
+
+      float leftArea[BINS - 1];
+      unsigned int leftCount[BINS - 1];
+      Bounds sweep;
+      unsigned int sum = 0;
+      for (int i = 0; i < BINS - 1; i++) {
+        sweep.grow(binBounds[i]);
+        sum += binCount[i];
+        leftArea[i] = sweep.area();
+        leftCount[i] = sum;
+      }
+      sweep = Bounds();
+      sum = 0;
+      for (int i = BINS - 1; i > 0; i--) {
+        sweep.grow(binBounds[i]);
+        sum += binCount[i];
+        const float cost = leftArea[i - 1] * leftCount[i - 1] + sweep.area() * sum;
+        if (leftCount[i - 1] && sum && cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestSplit = i;
+        }
+      }
+    }
+
+    // Traversal costs about as much as one triangle test.
+    const float leafCost = float(count);
+    bestCost = 1.0f + bestCost / max(box.area(), 1e-12f);
+    unsigned int middle;
+    if (bestAxis >= 0 && (bestCost < leafCost || count > MAX_LEAF_SIZE)) {
+      const float scale = BINS / extent[bestAxis];
+      const float minimum = centroidBox.min[bestAxis];
+      auto split = partition(
+          refs.begin() + first, refs.begin() + first + count,
+          [&](unsigned int ref) {
+            return min(BINS - 1, int((centroids[ref][bestAxis] - minimum) *
+                                     scale)) < bestSplit;
+          });
+      middle = unsigned(split - refs.begin());
+    } else if (count > MAX_LEAF_SIZE) {
+      // All centroids coincide, split in half to keep leaves small.
+      middle = first + count / 2;
+    } else {
+      makeLeaf(node, first, count);
+      return;
+    }
+    if (middle == first || middle == first + count) {
+      middle = first + count / 2;
+    }
+
+    const unsigned int left = used.fetch_add(2);
+    node.first = left;
+    node.count = 0;
+    const unsigned int leftCount = middle - first;
+    const unsigned int rightCount = count - leftCount;
+
+    if (count > PARALLEL_THRESHOLD && takeThread()) {
+      auto task = async(launch::async, [=] {
+        subdivide(left, first, leftCount, depth + 1);
+        spareThreads.fetch_add(1);
+      });
+      subdivide(left + 1, middle, rightCount, depth + 1);
+      task.get();
+    } else {
+      subdivide(left, first, leftCount, depth + 1);
+      subdivide(left + 1, middle, rightCount, depth + 1);
+    }
+  }
+
+  // Depth first layout: the children of a node sit together, followed by the
+  // whole left subtree.
+  void flatten(vector<Node> &out, unsigned int from, unsigned int to,
+               unsigned int &next) const {
+    out[to] = nodes[from];
+    if (nodes[from].count == 0) {
+      const unsigned int children = next;
+      next += 2;
+      out[to].first = children;
+      flatten(out, nodes[from].first, children, next);
+      flatten(out, nodes[from].first + 1, children + 1, next);
+    }
+  }
+};
+
+void BVH::addTriangle(const glm::vec3 &a, const glm::vec3 &b,
+                      const glm::vec3 &c, unsigned int object) {
+  ids.push_back(ids.size());
+  triangles.push_back({a, b, c});
+  objects.push_back(object);
+}
+
+void BVH::addQuad(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+                  const glm::vec3 &d, unsigned int object) {
+  addTriangle(a, b, c, object);
+  addTriangle(a, c, d, object);
+}
+
+void BVH::clear() {
+  triangles.clear();
+  ids.clear();
+  objects.clear();
+  nodes.clear();
+}
+
+void BVH::build(bool parallel) {
+  nodes.clear();
+  if (triangles.empty()) {
+    return;
+  }
+
+  const unsigned int count = triangles.size();
+  Builder builder(parallel);
+  builder.bounds.resize(count);
+  builder.centroids.resize(count);
+  builder.refs.resize(count);
+  builder.nodes.resize(2 * count - 1);
+  for (unsigned int i = 0; i < count; i++) {
+    const Triangle &tri = triangles[i];
+    builder.bounds[i].grow(tri.v0);
+    builder.bounds[i].grow(tri.v1);
+    builder.bounds[i].grow(tri.v2);
+    builder.centroids[i] = (tri.v0 + tri.v1 + tri.v2) / 3.0f;
+    builder.refs[i] = i;
+  }
+
+  builder.subdivide(0, 0, count, 0);
+
+  nodes.resize(builder.used);
+  unsigned int next = 1;
+  builder.flatten(nodes, 0, 0, next);
+
+  // Store triangles in leaf order.
+  vector<Triangle> sortedTriangles(count);
+  vector<unsigned int> sortedIds(count), sortedObjects(count);
+  for (unsigned int i = 0; i < count; i++) {
+    sortedTriangles[i] = triangles[builder.refs[i]];
+    sortedIds[i] = ids[builder.refs[i]];
+    sortedObjects[i] = objects[builder.refs[i]];
+  }
+  triangles.swap(sortedTriangles);
+  ids.swap(sortedIds);
+  objects.swap(sortedObjects);
+}
+
+bool BVH::intersect(const Ray &ray, Hit &hit) const {
+  if (nodes.empty()) {
+    return false;
+  }
+
+  const glm::vec3 invDirection = 1.0f / ray.direction;
+  float tMax = ray.tMax;
+  unsigned int best = 0;
+  bool found = false;
+
+  struct Entry {
+    unsigned int node;
+    float t;
+  } stack[MAX_DEPTH + 4];
+  int size = 0;
+
+  if (slab(nodes[0].boundsMin, nodes[0].boundsMax, ray.origin, invDirection,
+           tMax) == INFINITY) {
+    return false;
+  }
+  stack[size++] = {0, 0.0f};
+
+  while (size > 0) {
+    const Entry entry = stack[--size];
+    if (entry.t >= tMax) {
+      continue;
+    }
+    const Node *node = &nodes[entry.node];
+    while (node->count == 0) {
+      const Node &left = nodes[node->first];
+      const Node &right = nodes[node->first + 1];
+      float tLeft = slab(left.boundsMin, left.boundsMax, ray.origin,
+                         invDirection, tMax);
+      float tRight = slab(right.boundsMin, right.boundsMax, ray.origin,
+                          invDirection, tMax);
+      unsigned int near = node->first, far = node->first + 1;
+      if (tRight < tLeft) {
+        swap(tLeft, tRight);
+        swap(near, far);
+      }
+      if (tLeft == INFINITY) {
+        node = nullptr;
+        break;
+      }
+      if (tRight != INFINITY) {
+        stack[size++] = {far, tRight};
+      }
+      node = &nodes[near];
+    }
+    if (!node) {
+      continue;
+    }
+
+    for (unsigned int i = node->first; i < node->first + node->count; i++) {
+      const Triangle &tri = triangles[i];
+      const float t =
+          intersectTriangle(ray.origin, ray.direction, tri.v0, tri.v1, tri.v2);
+      if (t < tMax) {
+        tMax = t;
+        best = i;
+        found = true;
+      }
+    }
+  }
+
+  if (found) {
+    const Triangle &tri = triangles[best];
+    hit.t = tMax;
+    hit.triangle = ids[best];
+    hit.object = objects[best];
+    hit.point = ray.origin + ray.direction * tMax;
+    hit.normal = glm::normalize(glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0));
+    if (glm::dot(hit.normal, ray.direction) > 0.0f) {
+      hit.normal = -hit.normal;
+    }
+  }
+  return found;
+}
+
+bool BVH::sweepSphere(const glm::vec3 &from, const glm::vec3 &to, float radius,
+                      Hit &hit) const {
+  if (nodes.empty()) {
+    return false;
+  }
+
+  // Traverse as a ray against boxes grown by the radius.
+  const glm::vec3 move = to - from;
+  const glm::vec3 invMove = 1.0f / move;
+  const glm::vec3 grow(radius);
+  float tMax = 1.0f;
+  unsigned int best = 0;
+  bool found = false;
+  glm::vec3 bestContact;
+
+  struct Entry {
+    unsigned int node;
+    float t;
+  } stack[MAX_DEPTH + 4];
+  int size = 0;
+
+  const float tRoot = slab(nodes[0].boundsMin - grow, nodes[0].boundsMax + grow,
+                           from, invMove, tMax);
+  if (tRoot == INFINITY) {
+    return false;
+  }
+  stack[size++] = {0, tRoot};
+
+  while (size > 0) {
+    const Entry entry = stack[--size];
+    if (entry.t >= tMax) {
+      continue;
+    }
+    const Node &node = nodes[entry.node];
+    if (node.count == 0) {
+      // Nearer child first, so its contacts can cull the farther one.
+      const Node &left = nodes[node.first];
+      const Node &right = nodes[node.first + 1];
+      float tLeft = slab(left.boundsMin - grow, left.boundsMax + grow, from,
+                         invMove, tMax);
+      float tRight = slab(right.boundsMin - grow, right.boundsMax + grow, from,
+                          invMove, tMax);
+      unsigned int near = node.first, far = node.first + 1;
+      if (tRight < tLeft) {
+        swap(tLeft, tRight);
+        swap(near, far);
+      }
+      if (tRight != INFINITY) {
+        stack[size++] = {far, tRight};
+      }
+      if (tLeft != INFINITY) {
+        stack[size++] = {near, tLeft};
+      }
+      continue;
+    }
+    for (unsigned int i = node.first; i < node.first + node.count; i++) {
+      const Triangle &tri = triangles[i];
+      glm::vec3 contact(0.0f);
+      const float t = sweepTriangle(from, move, radius, tri.v0, tri.v1, tri.v2,
+                                    tMax, contact);
+      if (t < tMax) {
+        tMax = t;
+        best = i;
+        bestContact = contact;
+        found = true;
+      }
+    }
+  }
+
+  if (found) {
+    const glm::vec3 center = from + move * tMax;
+    hit.t = tMax;
+    hit.triangle = ids[best];
+    hit.object = objects[best];
+    hit.point = bestContact;
+    hit.normal = center - bestContact;
+    const float length = glm::length(hit.normal);
+    hit.normal = length > 1e-6f ? hit.normal / length : -glm::normalize(move);
+  }
+  return found;
+}
+
+glm::vec3 BVH::slideSphere(const glm::vec3 &from, const glm::vec3 &to,
+                           float radius) const {
+  // Stop this far from surfaces so the next sweep does not start touching.
+  const float skin = 1e-3f;
+  glm::vec3 position = from;
+  glm::vec3 remaining = to - from;
+
+  for (int i = 0; i < 4; i++) {
+    const float length = glm::length(remaining);
+    if (length < 1e-6f) {
+      break;
+    }
+    Hit hit;
+    if (!sweepSphere(position, position + remaining, radius, hit)) {
+      position += remaining;
+      break;
+    }
+    const float t = max(0.0f, hit.t - skin / length);
+    position += remaining * t;
+    remaining *= 1.0f - t;
+    // Drop the part of the movement that goes into the surface.
+    remaining -= hit.normal * min(0.0f, glm::dot(remaining, hit.normal));
+  }
+  return position;
+}
+
+} // namespace bvh
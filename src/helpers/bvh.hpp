@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <vector>
+using namespace std;
+
+namespace bvh {
+
+struct Ray {
+  glm::vec3 origin;
+  glm::vec3 direction;
+  float tMax = INFINITY;
+};
+
+struct Hit {
+  // Ray queries: distance in units of the ray direction.
+  // Sweep queries: fraction of the movement before contact.
+  float t = INFINITY;
+  unsigned int triangle = 0; // In the order the triangles were added
+  unsigned int object = 0;
+  glm::vec3 point;
+  // Ray queries: geometric normal facing the ray. Sweep queries: from the
+  // contact point towards the sphere center.
+  glm::vec3 normal;
+};
+
+// Bounding volume hierarchy over triangles, built with the binned surface area
+// heuristic. Nodes are stored depth first in a flat array with both children
+// of a node next to each other.
+class BVH {
+public:
+  // Adds an indexed mesh whose vertices have an objl-like `Position`.
+  template <typename V, typename I>
+  void addMesh(const V &vertices, const I &indices, const glm::mat4 &transform,
+               unsigned int object) {
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      const auto &a = vertices[indices[i]].Position;
+      const auto &b = vertices[indices[i + 1]].Position;
+      const auto &c = vertices[indices[i + 2]].Position;
+      addTriangle(glm::vec3(transform * glm::vec4(a.X, a.Y, a.Z, 1.0f)),
+                  glm::vec3(transform * glm::vec4(b.X, b.Y, b.Z, 1.0f)),
+                  glm::vec3(transform * glm::vec4(c.X, c.Y, c.Z, 1.0f)),
+                  object);
+    }
+  }
+  void addTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+                   unsigned int object);
+  void addQuad(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+               const glm::vec3 &d, unsigned int object);
+
+  // Builds the tree over every triangle added so far. Large subtrees are
+  // built on separate threads when `parallel` is set.
+  void build(bool parallel = true);
+  void clear();
+
+  // Closest hit along the ray. Triangles are double sided.
+  bool intersect(const Ray &ray, Hit &hit) const;
+  // First contact of a sphere moving from `from` to `to`.
+  bool sweepSphere(const glm::vec3 &from, const glm::vec3 &to, float radius,
+                   Hit &hit) const;
+  // Moves a sphere towards `to`, sliding along whatever it touches.
+  glm::vec3 slideSphere(const glm::vec3 &from, const glm::vec3 &to,
+                        float radius) const;
+
+  size_t triangleCount() const { return triangles.size(); }
+  size_t nodeCount() const { return nodes.size(); }
+
+private:
+  struct Node {
+    glm::vec3 boundsMin;
+    unsigned int first; // Left child, or first triangle of a leaf
+    glm::vec3 boundsMax;
+    unsigned int count; // Triangles in a leaf, 0 for interior nodes
+  };
+
+  struct Triangle {
+    glm::vec3 v0, v1, v2;
+  };
+
+  // Triangles are reordered so that every leaf is a contiguous range.
+  vector<Triangle> triangles;
+  vector<unsigned int> ids;
+  vector<unsigned int> objects;
+  vector<Node> nodes;
+
+  struct Builder;
+};
+
+} // namespace bvh
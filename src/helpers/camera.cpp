@@ -22,9 +22,9 @@ void Camera::computeMatrices(float dt) {
   verticalAngle += mouseSpeed * float(height / 2.0 - ypos);
 
   // Direction : Spherical coordinates to Cartesian coordinates conversion
-  glm::vec3 direction(cos(verticalAngle) * sin(horizontalAngle),
-                      sin(verticalAngle),
-                      cos(verticalAngle) * cos(horizontalAngle));
+  direction = glm::vec3(cos(verticalAngle) * sin(horizontalAngle),
+                        sin(verticalAngle),
+                        cos(verticalAngle) * cos(horizontalAngle));
 
   // Right vector
   glm::vec3 right = glm::vec3(sin(horizontalAngle - 3.14f / 2.0f), 0,
@@ -42,23 +42,26 @@ void Camera::computeMatrices(float dt) {
     mult = 3.0f;
   }
 
+  glm::vec3 target = position;
   // Move forward
   if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-    position += direction * dt * speed * mult;
+    target += direction * dt * speed * mult;
   }
   // Move backward
   if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-    position -= direction * dt * speed * mult;
+    target -= direction * dt * speed * mult;
   }
   // Strafe right
   if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-    position += right * dt * speed * mult;
+    target += right * dt * speed * mult;
   }
   // Strafe left
   if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-    position -= right * dt * speed * mult;
+    target -= right * dt * speed * mult;
   }
 
+  position = collider ? collider(position, target) : target;
+
   projectionMatrix = glm::perspective(glm::radians(45.0f),
                                       float(width) / height, 0.1f, 1000.0f);
   viewMatrix = glm::lookAt(position, position + direction, up);
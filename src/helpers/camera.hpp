@@ -2,6 +2,7 @@
 
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
+#include <functional>
 #include <glm/gtc/matrix_transform.hpp>
 
 class Camera {
@@ -13,6 +14,7 @@ private:
 
   // Initial position : on +Z
   glm::vec3 position = glm::vec3(25, 25, 25);
+  glm::vec3 direction = glm::vec3(0, 0, -1);
   // Initial horizontal angle : toward -Z
   float horizontalAngle = 3.14f;
   // Initial vertical angle : none
@@ -21,11 +23,22 @@ private:
   float speed = 30.0f;
   float mouseSpeed = 0.0025f;
 
+  // Returns where the camera ends up when it tries to move from -> to.
+  std::function<glm::vec3(const glm::vec3 &from, const glm::vec3 &to)>
+      collider;
+
 public:
   Camera(GLFWwindow *window, float speed = 30.0f, float mouseSpeed = 0.0025f);
 
   void computeMatrices(float dt);
 
+  void setCollider(std::function<glm::vec3(const glm::vec3 &, const glm::vec3 &)>
+                       collider) {
+    this->collider = collider;
+  }
+
   const glm::mat4 &getViewMatrix() const { return viewMatrix; }
   const glm::mat4 &getProjectionMatrix() const { return projectionMatrix; }
+  const glm::vec3 &getPosition() const { return position; }
+  const glm::vec3 &getDirection() const { return direction; }
 };
\ No newline at end of file
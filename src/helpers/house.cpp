@@ -0,0 +1,62 @@
+#include "house.hpp"
+
+namespace house {
+
+namespace {
+
+// Triangle fan over `count` corners with one face normal.
+void addFace(Part &part, const glm::vec3 &normal, const glm::vec3 *positions,
+             const glm::vec2 *texCoords, int count) {
+  const unsigned int first = part.vertices.size();
+  for (int i = 0; i < count; i++) {
+    part.vertices.push_back({texCoords[i], normal, positions[i]});
+  }
+  for (int i = 1; i + 1 < count; i++) {
+    part.indices.insert(part.indices.end(), {first, first + i, first + i + 1});
+  }
+}
+
+void addQuad(Part &part, const glm::vec3 &normal,
+             const glm::vec3 (&positions)[4], const glm::vec2 (&texCoords)[4]) {
+  addFace(part, normal, positions, texCoords, 4);
+}
+
+void addTriangle(Part &part, const glm::vec3 &normal,
+                 const glm::vec3 (&positions)[3],
+                 const glm::vec2 (&texCoords)[3]) {
+  addFace(part, normal, positions, texCoords, 3);
+}
+
+} // namespace
+
+Mesh build(float width, float wallHeight, float roofHeight, float length) {
+  Mesh mesh;
+  const glm::vec3 p(0.0f);
+  const glm::vec3 w(width, 0, 0), h(0, wallHeight, 0), l(0, 0, length);
+  addQuad(mesh.walls, {0, 0, -1}, {p, p + h, p + w + h, p + w},
+          {{0, 0}, {0, 8}, {8, 8}, {8, 0}});
+  addQuad(mesh.walls, {0, 0, 1}, {p + l, p + w + l, p + w + h + l, p + h + l},
+          {{0, 0}, {8, 0}, {8, 8}, {0, 8}});
+  addQuad(mesh.walls, {-1, 0, 0}, {p, p + l, p + h + l, p + h},
+          {{0, 0}, {8, 0}, {8, 8}, {0, 8}});
+  addQuad(mesh.walls, {1, 0, 0}, {p + w, p + w + h, p + w + h + l, p + w + l},
+          {{0, 0}, {0, 8}, {8, 8}, {8, 0}});
+
+  // Gables.
+  const glm::vec3 r = p + h;
+  const glm::vec3 top = r + glm::vec3(width / 2.0f, roofHeight, 0);
+  addTriangle(mesh.walls, {0, 0, -1}, {r, top, r + w},
+              {{0, 0}, {3, 6}, {6, 0}});
+  addTriangle(mesh.walls, {0, 0, 1}, {r + l, r + w + l, top + l},
+              {{0, 0}, {6, 0}, {3, 6}});
+
+  const glm::vec3 up(width / 2.0f, roofHeight, 0);
+  const glm::vec3 down(width / 2.0f, -roofHeight, 0);
+  addQuad(mesh.roof, glm::normalize(glm::cross(up, -l)),
+          {r, r + l, top + l, top}, {{0, 0}, {0, 8}, {8, 8}, {8, 0}});
+  addQuad(mesh.roof, glm::normalize(glm::cross(l, down)),
+          {r + w, top, top + l, r + w + l}, {{0, 0}, {8, 0}, {8, 8}, {0, 8}});
+  return mesh;
+}
+
+} // namespace house
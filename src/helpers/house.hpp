@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+using namespace std;
+
+// The lab4 house as indexed triangles, shared by the GL and software
+// renderers and the colliders. The house stands on the origin: width along
+// X, wall and roof height along Y, length along Z.
+namespace house {
+
+// Same layout as GL_T2F_N3F_V3F, like objl::Vertex.
+struct Vertex {
+  glm::vec2 texCoord;
+  glm::vec3 normal;
+  glm::vec3 position;
+};
+
+struct Part {
+  vector<Vertex> vertices;
+  vector<unsigned int> indices;
+};
+
+struct Mesh {
+  Part walls; // Including the gables, wall texture and material
+  Part roof;
+};
+
+Mesh build(float width, float wallHeight, float roofHeight, float length);
+
+} // namespace house
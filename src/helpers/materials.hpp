@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+// Materials and light of the lab4 scene, shared by the GL and software
+// renderers. RGBA values with the same meaning as glMaterial and glLight.
+namespace materials {
+
+struct Material {
+  float ambient[4];
+  float diffuse[4];
+  float specular[4];
+  float shininess;
+};
+
+// Materials the scene description can refer to.
+const unordered_map<string, Material> table = {
+    {"floor", {{0.4f, 0.4f, 0.4f, 1.0f}, {0.5f, 0.5f, 0.5f, 1.0f},
+               {0.2f, 0.2f, 0.2f, 1.0f}, 3.0f}},
+    {"wall", {{0.4f, 0.4f, 0.4f, 1.0f}, {0.2f, 0.2f, 0.2f, 1.0f},
+              {0.6f, 0.6f, 0.6f, 1.0f}, 13.0f}},
+    {"roof", {{0.4f, 0.4f, 0.4f, 1.0f}, {0.6f, 0.6f, 0.6f, 1.0f},
+              {0.8f, 0.8f, 0.8f, 1.0f}, 100.0f}},
+    {"leaves", {{0.4f, 0.4f, 0.4f, 1.0f}, {0.3f, 0.3f, 0.3f, 1.0f},
+                {0.9f, 0.9f, 0.9f, 1.0f}, 8.0f}},
+    {"log", {{0.4f, 0.4f, 0.4f, 1.0f}, {0.3f, 0.3f, 0.3f, 1.0f},
+             {0.2f, 0.2f, 0.2f, 1.0f}, 0.0f}}};
+
+struct Light {
+  float ambient[4];
+  float diffuse[4];
+  float specular[4];
+};
+
+// GL_LIGHT0, its position comes from the scene.
+const Light light = {{0.75f, 0.75f, 0.75f, 1.0f},
+                     {0.9f, 0.9f, 0.9f, 1.0f},
+                     {0.4f, 0.4f, 0.4f, 1.0f}};
+
+} // namespace materials
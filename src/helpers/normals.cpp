@@ -0,0 +1,417 @@
+#include "normals.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <thread>
+#include <unordered_map>
+
+namespace normals {
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+// Fewer triangles than this are processed on the calling thread.
+const size_t PARALLEL_THRESHOLD = 16 * 1024;
+
+double elapsedMs(Clock::time_point start) {
+  return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// Splits [0, count) in one contiguous chunk per thread and runs
+// job(thread, begin, end) on each, the calling thread taking the first.
+template <typename Job>
+void parallelFor(unsigned int threads, size_t count, const Job &job) {
+  vector<future<void>> tasks;
+  for (unsigned int t = 1; t < threads; t++) {
+    tasks.push_back(async(launch::async, [&job, t, threads, count] {
+      job(t, count * t / threads, count * (t + 1) / threads);
+    }));
+  }
+  job(0u, size_t(0), count / threads);
+  for (auto &task : tasks) {
+    task.get();
+  }
+}
+
+struct Key {
+  uint32_t x, y, z;
+  bool operator==(const Key &other) const {
+    return x == other.x && y == other.y && z == other.z;
+  }
+};
+
+struct KeyHash {
+  size_t operator()(const Key &key) const {
+    uint64_t h = key.x;
+    h = h * 0x9e3779b97f4a7c15ull + key.y;
+    h = h * 0x9e3779b97f4a7c15ull + key.z;
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93ull;
+    return h ^ (h >> 32);
+  }
+};
+
+Key positionKey(const glm::vec3 &position) {
+  // Adding 0 turns -0 into +0, so both weld together.
+  const glm::vec3 p = position + glm::vec3(0.0f);
+  Key key;
+  memcpy(&key, &p, sizeof(key));
+  return key;
+}
+
+// Groups the items [0, count) by owner(i) < threads, in ascending order
+// within every group: group t is items[starts[t]] to items[starts[t + 1] - 1].
+// Every thread only reads its own range of the input.
+template <typename Owner>
+void groupByOwner(unsigned int threads, size_t count, const Owner &owner,
+                  vector<unsigned int> &items, vector<size_t> &starts) {
+  if (threads == 1) {
+    items.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      items[i] = i;
+    }
+    starts = {0, count};
+    return;
+  }
+  vector<unsigned int> owners(count);
+  // How many items of every owner each range has, one row per range.
+  vector<size_t> counts(size_t(threads) * threads);
+  parallelFor(threads, count, [&](unsigned int t, size_t begin, size_t end) {
+    vector<size_t> mine(threads, 0);
+    for (size_t i = begin; i < end; i++) {
+      owners[i] = owner(i);
+      mine[owners[i]]++;
+    }
+    copy(mine.begin(), mine.end(), counts.begin() + size_t(t) * threads);
+  });
+
+  // Earlier ranges go first within a group, which keeps it sorted.
+  vector<size_t> offsets(counts.size());
+  starts.assign(threads + 1, 0);
+  size_t running = 0;
+  for (unsigned int o = 0; o < threads; o++) {
+    starts[o] = running;
+    for (unsigned int t = 0; t < threads; t++) {
+      offsets[size_t(t) * threads + o] = running;
+      running += counts[size_t(t) * threads + o];
+    }
+  }
+  starts[threads] = running;
+
+  items.resize(count);
+  parallelFor(threads, count, [&](unsigned int t, size_t begin, size_t end) {
+    vector<size_t> next(offsets.begin() + size_t(t) * threads,
+                        offsets.begin() + size_t(t + 1) * threads);
+    for (size_t i = begin; i < end; i++) {
+      items[next[owners[i]]++] = i;
+    }
+  });
+}
+
+// Same id for positions with the same coordinates. Every thread owns the
+// positions whose hash falls on it and keeps its own map, so nothing is
+// shared while welding.
+vector<unsigned int> weld(const vector<glm::vec3> &positions,
+                          unsigned int threads, unsigned int &count) {
+  const size_t n = positions.size();
+  vector<unsigned int> items;
+  vector<size_t> starts;
+  groupByOwner(
+      threads, n,
+      [&](size_t i) { return KeyHash()(positionKey(positions[i])) % threads; },
+      items, starts);
+
+  vector<unsigned int> ids(n), counts(threads);
+  parallelFor(threads, threads, [&](unsigned int t, size_t, size_t) {
+    unordered_map<Key, unsigned int, KeyHash> firstSeen;
+    firstSeen.reserve(starts[t + 1] - starts[t]);
+    for (size_t k = starts[t]; k < starts[t + 1]; k++) {
+      const Key key = positionKey(positions[items[k]]);
+      auto it = firstSeen.find(key);
+      if (it == firstSeen.end()) {
+        it = firstSeen.emplace(key, firstSeen.size()).first;
+      }
+      ids[items[k]] = it->second;
+    }
+    counts[t] = firstSeen.size();
+  });
+
+  vector<unsigned int> offsets(threads, 0);
+  for (unsigned int t = 1; t < threads; t++) {
+    offsets[t] = offsets[t - 1] + counts[t - 1];
+  }
+  count = offsets.back() + counts.back();
+  parallelFor(threads, threads, [&](unsigned int t, size_t, size_t) {
+    for (size_t k = starts[t]; k < starts[t + 1]; k++) {
+      ids[items[k]] += offsets[t];
+    }
+  });
+  return ids;
+}
+
+// Corners around every welded vertex, in corner order: those of vertex v are
+// corners[first[v]] to corners[first[v + 1] - 1]. Every thread owns a range
+// of vertices and only writes their counts and lists.
+void buildCorners(const vector<unsigned int> &vertexIds,
+                  const vector<unsigned int> &indices, unsigned int vertexCount,
+                  unsigned int threads, vector<unsigned int> &first,
+                  vector<unsigned int> &corners) {
+  first.assign(vertexCount + 1, 0);
+  corners.resize(indices.size());
+  const auto range = [&](unsigned int t, unsigned int &begin,
+                         unsigned int &end) {
+    begin = size_t(vertexCount) * t / threads;
+    end = size_t(vertexCount) * (t + 1) / threads;
+  };
+
+  // Thread t owns vertices from vertexCount * t / threads on.
+  vector<unsigned int> items;
+  vector<size_t> starts;
+  groupByOwner(
+      threads, indices.size(),
+      [&](size_t corner) {
+        const uint64_t v = vertexIds[indices[corner]];
+        return unsigned(((v + 1) * threads - 1) / vertexCount);
+      },
+      items, starts);
+
+  parallelFor(threads, threads, [&](unsigned int t, size_t, size_t) {
+    for (size_t k = starts[t]; k < starts[t + 1]; k++) {
+      first[vertexIds[indices[items[k]]] + 1]++;
+    }
+  });
+
+  parallelFor(threads, threads, [&](unsigned int t, size_t, size_t) {
+    unsigned int begin, end;
+    range(t, begin, end);
+    unsigned int running = starts[t];
+    for (unsigned int v = begin; v < end; v++) {
+      running += first[v + 1];
+      first[v + 1] = running;
+    }
+
+    // first[begin] belongs to the previous thread, it may still be writing it.
+    vector<unsigned int> next(end - begin);
+    for (unsigned int v = begin; v < end; v++) {
+      next[v - begin] = v == begin ? starts[t] : first[v];
+    }
+    for (size_t k = starts[t]; k < starts[t + 1]; k++) {
+      const unsigned int corner = items[k];
+      corners[next[vertexIds[indices[corner]] - begin]++] = corner;
+    }
+  });
+}
+
+// Any unit vector perpendicular to `normal`.
+glm::vec3 perpendicular(const glm::vec3 &normal) {
+  const glm::vec3 axis =
+      fabs(normal.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+  return glm::normalize(glm::cross(normal, axis));
+}
+
+} // namespace
+
+Result generate(const vector<glm::vec3> &positions,
+                const vector<glm::vec2> &texCoords,
+                const vector<unsigned int> &indices, const Options &options) {
+  Result result;
+  const size_t triangleCount = indices.size() / 3;
+  const size_t cornerCount = triangleCount * 3;
+  unsigned int threads =
+      options.threads ? options.threads
+                      : max(1u, thread::hardware_concurrency());
+  if (triangleCount < PARALLEL_THRESHOLD) {
+    threads = 1;
+  }
+
+  auto start = Clock::now();
+  unsigned int vertexCount;
+  const vector<unsigned int> vertexIds = weld(positions, threads, vertexCount);
+  vector<unsigned int> first, corners;
+  buildCorners(vertexIds, indices, vertexCount, threads, first, corners);
+  result.weldMs = elapsedMs(start);
+
+  // Face normals and corner weights.
+  start = Clock::now();
+  vector<glm::vec3> faceNormals(triangleCount);
+  vector<float> angles(cornerCount), weights(cornerCount);
+  parallelFor(threads, triangleCount, [&](unsigned int, size_t begin,
+                                          size_t end) {
+    for (size_t triangle = begin; triangle < end; triangle++) {
+      const glm::vec3 p[3] = {positions[indices[triangle * 3]],
+                              positions[indices[triangle * 3 + 1]],
+                              positions[indices[triangle * 3 + 2]]};
+      const glm::vec3 cross = glm::cross(p[1] - p[0], p[2] - p[0]);
+      const float doubleArea = glm::length(cross);
+      faceNormals[triangle] =
+          doubleArea > 0.0f ? cross / doubleArea : glm::vec3(0.0f);
+
+      for (int k = 0; k < 3; k++) {
+        const glm::vec3 a = p[(k + 1) % 3] - p[k];
+        const glm::vec3 b = p[(k + 2) % 3] - p[k];
+        const float lengths = glm::length(a) * glm::length(b);
+        const float angle =
+            lengths > 0.0f
+                ? acos(glm::clamp(glm::dot(a, b) / lengths, -1.0f, 1.0f))
+                : 0.0f;
+        const size_t corner = triangle * 3 + k;
+        angles[corner] = angle;
+        weights[corner] = options.weighting == AREA    ? doubleArea
+                          : options.weighting == ANGLE ? angle
+                                                       : doubleArea * angle;
+        if (doubleArea == 0.0f) {
+          weights[corner] = 0.0f;
+        }
+      }
+    }
+  });
+
+  // The faces around every vertex are clustered: a face joins the first
+  // cluster whose first face is within the crease angle of it, and all its
+  // corners get the normal of that cluster. Each vertex is handled by one
+  // thread and only writes its own corners, so no atomics are needed.
+  const float cosCrease = options.creaseAngle >= 180.0f
+                              ? -2.0f
+                              : cos(glm::radians(options.creaseAngle));
+  result.normals.resize(cornerCount);
+  vector<unsigned int> clusters(cornerCount);
+  parallelFor(threads, vertexCount, [&](unsigned int, size_t begin,
+                                        size_t end) {
+    vector<glm::vec3> seeds, sums;
+    for (size_t v = begin; v < end; v++) {
+      seeds.clear();
+      sums.clear();
+      for (unsigned int i = first[v]; i < first[v + 1]; i++) {
+        const unsigned int corner = corners[i];
+        const glm::vec3 &faceNormal = faceNormals[corner / 3];
+        // Degenerate faces take whatever the first cluster has.
+        unsigned int cluster = 0;
+        if (faceNormal != glm::vec3(0.0f)) {
+          while (cluster < seeds.size() &&
+                 glm::dot(faceNormal, seeds[cluster]) < cosCrease) {
+            cluster++;
+          }
+          if (cluster == seeds.size()) {
+            seeds.push_back(faceNormal);
+            sums.push_back(glm::vec3(0.0f));
+          }
+          sums[cluster] += weights[corner] * faceNormal;
+        }
+        clusters[corner] = cluster;
+      }
+
+      for (unsigned int i = first[v]; i < first[v + 1]; i++) {
+        const unsigned int corner = corners[i];
+        const glm::vec3 &faceNormal = faceNormals[corner / 3];
+        const glm::vec3 sum = clusters[corner] < sums.size()
+                                  ? sums[clusters[corner]]
+                                  : glm::vec3(0.0f);
+        const float length = glm::length(sum);
+        // Without any weight, fall back to the face normal or point up.
+        result.normals[corner] =
+            length > 0.0f ? sum / length
+            : glm::length(faceNormal) > 0.0f ? faceNormal
+                                             : glm::vec3(0, 1, 0);
+      }
+    }
+  });
+  result.normalsMs = elapsedMs(start);
+
+  if (!options.tangents || texCoords.size() != positions.size()) {
+    return result;
+  }
+
+  // Face tangents along increasing s, flipped when the texture is mirrored.
+  start = Clock::now();
+  vector<glm::vec3> faceTangents(triangleCount);
+  vector<unsigned char> preserving(triangleCount);
+  parallelFor(threads, triangleCount, [&](unsigned int, size_t begin,
+                                          size_t end) {
+    for (size_t triangle = begin; triangle < end; triangle++) {
+      const unsigned int *index = &indices[triangle * 3];
+      const glm::vec3 d1 = positions[index[1]] - positions[index[0]];
+      const glm::vec3 d2 = positions[index[2]] - positions[index[0]];
+      const glm::vec2 t1 = texCoords[index[1]] - texCoords[index[0]];
+      const glm::vec2 t2 = texCoords[index[2]] - texCoords[index[0]];
+      const float signedArea = t1.x * t2.y - t1.y * t2.x;
+      preserving[triangle] = signedArea > 0.0f;
+
+      const glm::vec3 tangent = t2.y * d1 - t1.y * d2;
+      const float length = glm::length(tangent);
+      faceTangents[triangle] =
+          signedArea != 0.0f && length > 0.0f
+              ? tangent * ((signedArea > 0.0f ? 1.0f : -1.0f) / length)
+              : glm::vec3(0.0f);
+    }
+  });
+
+  // Corners with the same vertex, normal cluster, texture coordinate and
+  // orientation share a tangent, weighted by their angle like the normals.
+  // Sorting the corners of a vertex puts every group in one run.
+  result.tangents.resize(cornerCount);
+  const auto groupOrder = [&](unsigned int a, unsigned int b) {
+    if (clusters[a] != clusters[b]) {
+      return clusters[a] < clusters[b];
+    }
+    if (preserving[a / 3] != preserving[b / 3]) {
+      return preserving[a / 3] < preserving[b / 3];
+    }
+    const glm::vec2 &ta = texCoords[indices[a]], &tb = texCoords[indices[b]];
+    if (ta.x != tb.x) {
+      return ta.x < tb.x;
+    }
+    if (ta.y != tb.y) {
+      return ta.y < tb.y;
+    }
+    return a < b;
+  };
+  const auto sameGroup = [&](unsigned int a, unsigned int b) {
+    return clusters[a] == clusters[b] && preserving[a / 3] == preserving[b / 3] &&
+           texCoords[indices[a]] == texCoords[indices[b]];
+  };
+  parallelFor(threads, vertexCount, [&](unsigned int, size_t begin,
+                                        size_t end) {
+    vector<unsigned int> order;
+    for (size_t v = begin; v < end; v++) {
+      order.assign(corners.begin() + first[v], corners.begin() + first[v + 1]);
+      sort(order.begin(), order.end(), groupOrder);
+
+      for (size_t run = 0; run < order.size();) {
+        size_t runEnd = run + 1;
+        while (runEnd < order.size() && sameGroup(order[run], order[runEnd])) {
+          runEnd++;
+        }
+        const glm::vec3 &groupNormal = result.normals[order[run]];
+        glm::vec3 sum(0.0f);
+        for (size_t k = run; k < runEnd; k++) {
+          const glm::vec3 &faceTangent = faceTangents[order[k] / 3];
+          const glm::vec3 projected =
+              faceTangent - groupNormal * glm::dot(groupNormal, faceTangent);
+          const float length = glm::length(projected);
+          if (length > 0.0f) {
+            sum += angles[order[k]] * projected / length;
+          }
+        }
+
+        for (size_t k = run; k < runEnd; k++) {
+          const unsigned int corner = order[k];
+          const glm::vec3 &normal = result.normals[corner];
+          const glm::vec3 tangent = sum - normal * glm::dot(normal, sum);
+          const float length = glm::length(tangent);
+          result.tangents[corner] =
+              glm::vec4(length > 0.0f ? tangent / length : perpendicular(normal),
+                        preserving[corner / 3] ? 1.0f : -1.0f);
+        }
+        run = runEnd;
+      }
+    }
+  });
+  result.tangentsMs = elapsedMs(start);
+  return result;
+}
+
+} // namespace normals
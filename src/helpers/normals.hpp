@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+using namespace std;
+
+// Smooth vertex normals and tangents for meshes that come without them.
+// Tangents follow the MikkTSpace conventions: per face tangents from the
+// texture coordinate gradients, projected on the vertex normal, averaged
+// over corners that share position, normal, texture coordinate and
+// orientation, and a handedness sign in w.
+namespace normals {
+
+enum Weighting { AREA, ANGLE, AREA_AND_ANGLE };
+
+struct Options {
+  Weighting weighting = ANGLE;
+  // Degrees. Faces meeting at a sharper angle keep separate normals.
+  float creaseAngle = 60.0f;
+  bool tangents = true;
+  unsigned int threads = 0; // 0: hardware concurrency
+};
+
+// One normal and tangent per index, so corners on both sides of a crease can
+// differ even when they share a vertex.
+struct Result {
+  vector<glm::vec3> normals;
+  // The bitangent is w * cross(normal, tangent). Empty without texture
+  // coordinates or when tangents are not requested.
+  vector<glm::vec4> tangents;
+  double weldMs = 0.0;
+  double normalsMs = 0.0;
+  double tangentsMs = 0.0;
+};
+
+// Triangles are smoothed across corners at the same position, whether or not
+// they share an index. `texCoords` is either empty or one per position.
+Result generate(const vector<glm::vec3> &positions,
+                const vector<glm::vec2> &texCoords,
+                const vector<unsigned int> &indices,
+                const Options &options = Options());
+
+// Replaces the `Normal` of objl-like vertices and returns one tangent per
+// vertex. objl gives every face corner its own vertex, so creases are kept;
+// a vertex shared across a crease ends up with one of its normals. Only
+// vertices with `replace` set get a new normal, like objl's FlatNormals, so
+// authored ones survive in mixed files; an empty `replace` replaces all.
+template <typename V>
+vector<glm::vec4> regenerate(vector<V> &vertices,
+                             const vector<unsigned int> &indices,
+                             const vector<bool> &replace,
+                             const Options &options = Options()) {
+  vector<glm::vec3> positions(vertices.size());
+  vector<glm::vec2> texCoords(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    const auto &v = vertices[i];
+    positions[i] = glm::vec3(v.Position.X, v.Position.Y, v.Position.Z);
+    texCoords[i] = glm::vec2(v.TextureCoordinate.X, v.TextureCoordinate.Y);
+  }
+  const Result result = generate(positions, texCoords, indices, options);
+
+  vector<glm::vec4> tangents(result.tangents.empty() ? 0 : vertices.size());
+  for (size_t corner = 0; corner < indices.size(); corner++) {
+    auto &normal = vertices[indices[corner]].Normal;
+    const bool replaced = replace.empty() || replace[indices[corner]];
+    if (replaced) {
+      normal.X = result.normals[corner].x;
+      normal.Y = result.normals[corner].y;
+      normal.Z = result.normals[corner].z;
+    }
+    if (tangents.empty()) {
+      continue;
+    }
+    glm::vec4 tangent = result.tangents[corner];
+    if (!replaced) {
+      // Keep the tangent perpendicular to the authored normal.
+      const glm::vec3 n =
+          glm::normalize(glm::vec3(normal.X, normal.Y, normal.Z));
+      const glm::vec3 t =
+          glm::vec3(tangent) - n * glm::dot(n, glm::vec3(tangent));
+      if (glm::dot(t, t) > 1e-12f) {
+        tangent = glm::vec4(glm::normalize(t), tangent.w);
+      }
+    }
+    tangents[indices[corner]] = tangent;
+  }
+  return tangents;
+}
+
+template <typename V>
+vector<glm::vec4> regenerate(vector<V> &vertices,
+                             const vector<unsigned int> &indices,
+                             const Options &options = Options()) {
+  return regenerate(vertices, indices, vector<bool>(), options);
+}
+
+} // namespace normals
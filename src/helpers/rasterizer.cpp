@@ -0,0 +1,518 @@
+#include "rasterizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stb/stb_image.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace software {
+
+namespace {
+
+// Triangles are clipped to this many viewports around the screen, so edge
+// functions stay precise without clipping every triangle to the screen.
+const float GUARD_BAND = 4.0f;
+
+inline uint32_t pack(const glm::vec3 &color) {
+  const glm::vec3 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+  return uint32_t(c.r) | uint32_t(c.g) << 8 | uint32_t(c.b) << 16 |
+         0xff000000u;
+}
+
+inline glm::vec3 unpack(uint32_t texel) {
+  return glm::vec3(texel & 0xff, (texel >> 8) & 0xff, (texel >> 16) & 0xff) /
+         255.0f;
+}
+
+inline int wrap(int i, int size) {
+  i %= size;
+  return i < 0 ? i + size : i;
+}
+
+} // namespace
+
+bool Texture::load(const string &path) {
+  int nrChannels;
+  unsigned char *data = stbi_load(path.data(), &width, &height, &nrChannels, 4);
+  if (!data) {
+    cout << "Failed to load texture: " << path << endl;
+    width = height = 0;
+    texels.clear();
+    return false;
+  }
+  texels.resize(size_t(width) * height);
+  memcpy(texels.data(), data, texels.size() * 4);
+  stbi_image_free(data);
+  return true;
+}
+
+glm::vec3 Texture::sample(float s, float t) const {
+  const float x = s * width - 0.5f;
+  const float y = t * height - 0.5f;
+  const float fx = floor(x), fy = floor(y);
+  const float tx = x - fx, ty = y - fy;
+  const int x0 = wrap(int(fx), width), x1 = wrap(int(fx) + 1, width);
+  const int y0 = wrap(int(fy), height), y1 = wrap(int(fy) + 1, height);
+
+  const uint32_t *row0 = &texels[size_t(y0) * width];
+  const uint32_t *row1 = &texels[size_t(y1) * width];
+  const glm::vec3 top = glm::mix(unpack(row0[x0]), unpack(row0[x1]), tx);
+  const glm::vec3 bottom = glm::mix(unpack(row1[x0]), unpack(row1[x1]), tx);
+  return glm::mix(top, bottom, ty);
+}
+
+Renderer::Renderer(int width, int height, unsigned int threads)
+    : width(width), height(height), nextTile(0) {
+  tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+  tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+  threadCount = threads ? threads : max(1u, thread::hardware_concurrency());
+  color.resize(size_t(width) * height);
+  depth.resize(size_t(width) * height);
+  triangles.resize(threadCount);
+  bins.assign(threadCount, vector<vector<unsigned int>>(tilesX * tilesY));
+
+  for (unsigned int i = 1; i < threadCount; i++) {
+    workers.emplace_back(&Renderer::workerLoop, this, i);
+  }
+}
+
+Renderer::~Renderer() {
+  {
+    lock_guard<mutex> lock(poolMutex);
+    stopping = true;
+  }
+  poolStart.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void Renderer::workerLoop(unsigned int index) {
+  unsigned long long seen = 0;
+  while (true) {
+    function<void(unsigned int)> current;
+    {
+      unique_lock<mutex> lock(poolMutex);
+      poolStart.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping) {
+        return;
+      }
+      seen = generation;
+      current = job;
+    }
+    current(index);
+    {
+      lock_guard<mutex> lock(poolMutex);
+      running--;
+    }
+    poolDone.notify_one();
+  }
+}
+
+void Renderer::parallel(const function<void(unsigned int)> &job) {
+  {
+    lock_guard<mutex> lock(poolMutex);
+    this->job = job;
+    generation++;
+    running = threadCount - 1;
+  }
+  poolStart.notify_all();
+  job(0);
+  unique_lock<mutex> lock(poolMutex);
+  poolDone.wait(lock, [this] { return running == 0; });
+}
+
+void Renderer::draw(const Mesh &mesh, const glm::mat4 &model,
+                    const Texture *texture, const Material &material) {
+  size_t firstVertex = 0;
+  if (!draws.empty()) {
+    firstVertex = draws.back().firstVertex + draws.back().mesh->vertices.size();
+  }
+  draws.push_back({&mesh, model, texture, material, firstVertex, triangleTotal});
+  triangleTotal += mesh.indices.size() / 3;
+}
+
+void Renderer::render(const glm::mat4 &view, const glm::mat4 &projection) {
+  size_t vertexTotal = 0;
+  if (!draws.empty()) {
+    vertexTotal = draws.back().firstVertex + draws.back().mesh->vertices.size();
+  }
+  clipVertices.resize(vertexTotal);
+
+  // Light in eye space, like glLightfv with the view matrix loaded.
+  const bool directional = light.position.w == 0.0f;
+  const glm::vec4 lightEye = view * light.position;
+  const glm::vec3 lightVector = directional
+                                    ? glm::normalize(glm::vec3(lightEye))
+                                    : glm::vec3(lightEye) / lightEye.w;
+
+  parallel([&](unsigned int thread) {
+    shadeVertices(thread, view, projection, lightVector, directional);
+  });
+  parallel([this](unsigned int thread) { setupTriangles(thread); });
+  nextTile = 0;
+  parallel([this](unsigned int) { rasterizeTiles(); });
+
+  draws.clear();
+  triangleTotal = 0;
+}
+
+void Renderer::shadeVertices(unsigned int thread, const glm::mat4 &view,
+                             const glm::mat4 &projection,
+                             const glm::vec3 &lightEye, bool directional) {
+  for (const Draw &draw : draws) {
+    const vector<Vertex> &vertices = draw.mesh->vertices;
+    const size_t begin = vertices.size() * thread / threadCount;
+    const size_t end = vertices.size() * (thread + 1) / threadCount;
+
+    const glm::mat4 modelView = view * draw.model;
+    const glm::mat4 mvp = projection * modelView;
+    const glm::mat3 normalMatrix =
+        glm::transpose(glm::inverse(glm::mat3(modelView)));
+    const Material &m = draw.material;
+    const glm::vec3 ambient = sceneAmbient * m.ambient + light.ambient * m.ambient;
+
+    for (size_t i = begin; i < end; i++) {
+      const Vertex &vertex = vertices[i];
+      ClipVertex &out = clipVertices[draw.firstVertex + i];
+      const glm::vec4 position(vertex.position, 1.0f);
+      out.position = mvp * position;
+      out.texCoord = vertex.texCoord;
+
+      // Fixed function lighting with a non local viewer.
+      const glm::vec3 eye = glm::vec3(modelView * position);
+      const glm::vec3 normal = glm::normalize(normalMatrix * vertex.normal);
+      const glm::vec3 toLight =
+          directional ? lightEye : glm::normalize(lightEye - eye);
+      const float diffuse = max(glm::dot(normal, toLight), 0.0f);
+      glm::vec3 lit = ambient + light.diffuse * m.diffuse * diffuse;
+      if (diffuse > 0.0f) {
+        const glm::vec3 half = glm::normalize(toLight + glm::vec3(0, 0, 1));
+        lit += light.specular * m.specular *
+               pow(max(glm::dot(normal, half), 0.0f), m.shininess);
+      }
+      out.color = glm::clamp(lit, 0.0f, 1.0f);
+    }
+  }
+}
+
+void Renderer::setupTriangles(unsigned int thread) {
+  triangles[thread].clear();
+  for (auto &bin : bins[thread]) {
+    bin.clear();
+  }
+
+  const size_t begin = triangleTotal * thread / threadCount;
+  const size_t end = triangleTotal * (thread + 1) / threadCount;
+  size_t d = 0;
+  for (size_t index = begin; index < end; index++) {
+    while (index >= draws[d].firstTriangle + draws[d].mesh->indices.size() / 3) {
+      d++;
+    }
+    const Draw &draw = draws[d];
+    const unsigned int *indices =
+        &draw.mesh->indices[(index - draw.firstTriangle) * 3];
+    ClipVertex polygon[9] = {clipVertices[draw.firstVertex + indices[0]],
+                             clipVertices[draw.firstVertex + indices[1]],
+                             clipVertices[draw.firstVertex + indices[2]]};
+
+    // Distance to the near plane and the guard band planes, inside >= 0.
+    const auto distance = [](const ClipVertex &v, int plane) {
+      const glm::vec4 &p = v.position;
+      switch (plane) {
+      case 0:
+        return p.z + p.w;
+      case 1:
+        return GUARD_BAND * p.w - p.x;
+      case 2:
+        return GUARD_BAND * p.w + p.x;
+      case 3:
+        return GUARD_BAND * p.w - p.y;
+      default:
+        return GUARD_BAND * p.w + p.y;
+      }
+    };
+
+    // Whole triangle outside the view frustum.
+    const glm::vec4 &a = polygon[0].position, &b = polygon[1].position,
+                    &c = polygon[2].position;
+    if ((a.x > a.w && b.x > b.w && c.x > c.w) ||
+        (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+        (a.y > a.w && b.y > b.w && c.y > c.w) ||
+        (a.y < -a.w && b.y < -b.w && c.y < -c.w) ||
+        (a.z > a.w && b.z > b.w && c.z > c.w) ||
+        (a.z < -a.w && b.z < -b.w && c.z < -c.w)) {
+      continue;
+    }
+
+    // Sutherland-Hodgman, only for the few triangles that need it.
+    int count = 3;
+    for (int plane = 0; plane < 5 && count >= 3; plane++) {
+      bool outside = false;
+      for (int i = 0; i < count; i++) {
+        outside = outside || distance(polygon[i], plane) < 0.0f;
+      }
+      if (!outside) {
+        continue;
+      }
+      ClipVertex clipped[9];
+      int clippedCount = 0;
+      for (int i = 0; i < count; i++) {
+        const ClipVertex &from = polygon[i];
+        const ClipVertex &to = polygon[(i + 1) % count];
+        const float dFrom = distance(from, plane);
+        const float dTo = distance(to, plane);
+        if (dFrom >= 0.0f) {
+          clipped[clippedCount++] = from;
+        }
+        if ((dFrom >= 0.0f) != (dTo >= 0.0f)) {
+          const float t = dFrom / (dFrom - dTo);
+          ClipVertex &v = clipped[clippedCount++];
+          v.position = glm::mix(from.position, to.position, t);
+          v.color = glm::mix(from.color, to.color, t);
+          v.texCoord = glm::mix(from.texCoord, to.texCoord, t);
+        }
+      }
+      copy(clipped, clipped + clippedCount, polygon);
+      count = clippedCount;
+    }
+
+    for (int i = 1; i + 1 < count; i++) {
+      const ClipVertex fan[3] = {polygon[0], polygon[i], polygon[i + 1]};
+      setup(thread, fan, draw.texture);
+    }
+  }
+}
+
+void Renderer::setup(unsigned int thread, const ClipVertex *vertices,
+                     const Texture *texture) {
+  float x[3], y[3], z[3], invW[3];
+  for (int i = 0; i < 3; i++) {
+    const glm::vec4 &p = vertices[i].position;
+    invW[i] = 1.0f / p.w;
+    x[i] = (p.x * invW[i] * 0.5f + 0.5f) * width;
+    y[i] = (0.5f - p.y * invW[i] * 0.5f) * height;
+    z[i] = p.z * invW[i] * 0.5f + 0.5f;
+  }
+
+  // Counter-clockwise (front facing) triangles have a negative area once y
+  // points down.
+  const float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if (area == 0.0f || (cullBackFaces && area > 0.0f)) {
+    return;
+  }
+
+  Triangle tri;
+  tri.minX = max(0, int(floor(min(min(x[0], x[1]), x[2]))));
+  tri.minY = max(0, int(floor(min(min(y[0], y[1]), y[2]))));
+  tri.maxX = min(width - 1, int(ceil(max(max(x[0], x[1]), x[2]))));
+  tri.maxY = min(height - 1, int(ceil(max(max(y[0], y[1]), y[2]))));
+  if (tri.minX > tri.maxX || tri.minY > tri.maxY) {
+    return;
+  }
+
+  // Edge opposite to vertex i, scaled so it is 1 at vertex i.
+  const float invArea = 1.0f / area;
+  for (int i = 0; i < 3; i++) {
+    const int from = (i + 1) % 3, to = (i + 2) % 3;
+    Plane &edge = tri.edges[i];
+    edge.a = (y[from] - y[to]) * invArea;
+    edge.b = (x[to] - x[from]) * invArea;
+    edge.c = -(edge.a * x[from] + edge.b * y[from]);
+  }
+  const auto plane = [&](float v0, float v1, float v2) {
+    const Plane *e = tri.edges;
+    return Plane{v0 * e[0].a + v1 * e[1].a + v2 * e[2].a,
+                 v0 * e[0].b + v1 * e[1].b + v2 * e[2].b,
+                 v0 * e[0].c + v1 * e[1].c + v2 * e[2].c};
+  };
+  const ClipVertex *v = vertices;
+  tri.depth = plane(z[0], z[1], z[2]);
+  tri.invW = plane(invW[0], invW[1], invW[2]);
+  tri.s = plane(v[0].texCoord.s * invW[0], v[1].texCoord.s * invW[1],
+                v[2].texCoord.s * invW[2]);
+  tri.t = plane(v[0].texCoord.t * invW[0], v[1].texCoord.t * invW[1],
+                v[2].texCoord.t * invW[2]);
+  tri.r = plane(v[0].color.r * invW[0], v[1].color.r * invW[1],
+                v[2].color.r * invW[2]);
+  tri.g = plane(v[0].color.g * invW[0], v[1].color.g * invW[1],
+                v[2].color.g * invW[2]);
+  tri.b = plane(v[0].color.b * invW[0], v[1].color.b * invW[1],
+                v[2].color.b * invW[2]);
+  tri.texture = texture;
+
+  const unsigned int index = triangles[thread].size();
+  triangles[thread].push_back(tri);
+  for (int ty = tri.minY / TILE_SIZE; ty <= tri.maxY / TILE_SIZE; ty++) {
+    for (int tx = tri.minX / TILE_SIZE; tx <= tri.maxX / TILE_SIZE; tx++) {
+      bins[thread][ty * tilesX + tx].push_back(index);
+    }
+  }
+}
+
+void Renderer::rasterizeTiles() {
+  const unsigned int tileCount = tilesX * tilesY;
+  const uint32_t clear = pack(clearColor);
+  unsigned int tile;
+  while ((tile = nextTile++) < tileCount) {
+    const int x0 = (tile % tilesX) * TILE_SIZE;
+    const int y0 = (tile / tilesX) * TILE_SIZE;
+    const int x1 = min(x0 + TILE_SIZE, width) - 1;
+    const int y1 = min(y0 + TILE_SIZE, height) - 1;
+
+    for (int y = y0; y <= y1; y++) {
+      fill(&color[size_t(y) * width + x0], &color[size_t(y) * width + x1] + 1,
+           clear);
+      fill(&depth[size_t(y) * width + x0], &depth[size_t(y) * width + x1] + 1,
+           1.0f);
+    }
+
+    // Threads binned consecutive ranges of triangles, so walking them in
+    // order keeps the submission order.
+    for (unsigned int t = 0; t < threadCount; t++) {
+      for (unsigned int index : bins[t][tile]) {
+        const Triangle &tri = triangles[t][index];
+        rasterize(tri, max(x0, tri.minX), max(y0, tri.minY), min(x1, tri.maxX),
+                  min(y1, tri.maxY));
+      }
+    }
+  }
+}
+
+#ifdef __SSE2__
+
+// Four pixels of a row at a time.
+void Renderer::rasterize(const Triangle &tri, int x0, int y0, int x1, int y1) {
+  const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 rowEnd = _mm_set1_ps(float(x1 + 1));
+
+  for (int y = y0; y <= y1; y++) {
+    const float py = y + 0.5f;
+    const auto row = [py](const Plane &p) {
+      return _mm_set1_ps(p.b * py + p.c);
+    };
+    const __m128 e0Row = row(tri.edges[0]), e1Row = row(tri.edges[1]),
+                 e2Row = row(tri.edges[2]), depthRow = row(tri.depth);
+    float *depthLine = &depth[size_t(y) * width];
+    uint32_t *colorLine = &color[size_t(y) * width];
+
+    for (int x = x0; x <= x1; x += 4) {
+      const __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), laneOffsets);
+      const auto eval = [px](const Plane &p, __m128 rowValue) {
+        return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.a), px), rowValue);
+      };
+      __m128 mask = _mm_and_ps(
+          _mm_and_ps(_mm_cmpge_ps(eval(tri.edges[0], e0Row), zero),
+                     _mm_cmpge_ps(eval(tri.edges[1], e1Row), zero)),
+          _mm_and_ps(_mm_cmpge_ps(eval(tri.edges[2], e2Row), zero),
+                     _mm_cmplt_ps(px, rowEnd)));
+      if (!_mm_movemask_ps(mask)) {
+        continue;
+      }
+
+      // Depth test, GL_LESS against a buffer cleared to 1.
+      __m128 stored;
+      if (x + 3 <= x1) {
+        stored = _mm_loadu_ps(depthLine + x);
+      } else {
+        float lanes[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int i = 0; x + i <= x1; i++) {
+          lanes[i] = depthLine[x + i];
+        }
+        stored = _mm_loadu_ps(lanes);
+      }
+      const __m128 z = eval(tri.depth, depthRow);
+      mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmplt_ps(z, stored),
+                                         _mm_and_ps(_mm_cmpge_ps(z, zero),
+                                                    _mm_cmple_ps(z, one))));
+      const int bits = _mm_movemask_ps(mask);
+      if (!bits) {
+        continue;
+      }
+
+      // Perspective correct attributes.
+      const __m128 w = _mm_div_ps(one, eval(tri.invW, row(tri.invW)));
+      float zs[4], s[4], t[4], r[4], g[4], b[4];
+      _mm_storeu_ps(zs, z);
+      _mm_storeu_ps(s, _mm_mul_ps(eval(tri.s, row(tri.s)), w));
+      _mm_storeu_ps(t, _mm_mul_ps(eval(tri.t, row(tri.t)), w));
+      _mm_storeu_ps(r, _mm_mul_ps(eval(tri.r, row(tri.r)), w));
+      _mm_storeu_ps(g, _mm_mul_ps(eval(tri.g, row(tri.g)), w));
+      _mm_storeu_ps(b, _mm_mul_ps(eval(tri.b, row(tri.b)), w));
+
+      for (int i = 0; i < 4; i++) {
+        if (!(bits & (1 << i))) {
+          continue;
+        }
+        glm::vec3 shaded(r[i], g[i], b[i]);
+        if (tri.texture) {
+          shaded *= tri.texture->sample(s[i], t[i]);
+        }
+        depthLine[x + i] = zs[i];
+        colorLine[x + i] = pack(shaded);
+      }
+    }
+  }
+}
+
+#else
+
+void Renderer::rasterize(const Triangle &tri, int x0, int y0, int x1, int y1) {
+  const auto eval = [](const Plane &p, float x, float y) {
+    return p.a * x + (p.b * y + p.c);
+  };
+  for (int y = y0; y <= y1; y++) {
+    const float py = y + 0.5f;
+    for (int x = x0; x <= x1; x++) {
+      const float px = x + 0.5f;
+      if (eval(tri.edges[0], px, py) < 0.0f ||
+          eval(tri.edges[1], px, py) < 0.0f ||
+          eval(tri.edges[2], px, py) < 0.0f) {
+        continue;
+      }
+      const float z = eval(tri.depth, px, py);
+      float &stored = depth[size_t(y) * width + x];
+      if (!(z < stored) || z < 0.0f || z > 1.0f) {
+        continue;
+      }
+      const float w = 1.0f / eval(tri.invW, px, py);
+      glm::vec3 shaded(eval(tri.r, px, py), eval(tri.g, px, py),
+                       eval(tri.b, px, py));
+      shaded *= w;
+      if (tri.texture) {
+        shaded *= tri.texture->sample(eval(tri.s, px, py) * w,
+                                      eval(tri.t, px, py) * w);
+      }
+      stored = z;
+      color[size_t(y) * width + x] = pack(shaded);
+    }
+  }
+}
+
+#endif
+
+bool Renderer::write(const string &path) const {
+  FILE *file = fopen(path.data(), "wb");
+  if (!file) {
+    cout << "Failed to write image: " << path << endl;
+    return false;
+  }
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+  vector<unsigned char> rgb(size_t(width) * height * 3);
+  for (size_t i = 0; i < color.size(); i++) {
+    rgb[i * 3] = color[i] & 0xff;
+    rgb[i * 3 + 1] = (color[i] >> 8) & 0xff;
+    rgb[i * 3 + 2] = (color[i] >> 16) & 0xff;
+  }
+  const bool ok = fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+  fclose(file);
+  return ok;
+}
+
+} // namespace software
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// CPU renderer for machines without a GL context. It draws the same meshes,
+// materials and light as the fixed function examples: per vertex lighting,
+// modulated by a bilinearly filtered texture, with depth testing and back face
+// culling.
+namespace software {
+
+struct Texture {
+  int width = 0;
+  int height = 0;
+  vector<uint32_t> texels; // RGBA8, first row is t = 0 like glTexImage2D
+
+  bool load(const string &path);
+  // Bilinear sample with GL_REPEAT wrapping.
+  glm::vec3 sample(float s, float t) const;
+};
+
+struct Vertex {
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec2 texCoord;
+};
+
+struct Mesh {
+  vector<Vertex> vertices;
+  vector<unsigned int> indices;
+
+  // Copies an indexed mesh whose vertices look like objl::Vertex.
+  template <typename V, typename I>
+  Mesh(const V &meshVertices, const I &meshIndices)
+      : indices(meshIndices.begin(), meshIndices.end()) {
+    vertices.reserve(meshVertices.size());
+    for (const auto &v : meshVertices) {
+      vertices.push_back({{v.Position.X, v.Position.Y, v.Position.Z},
+                          {v.Normal.X, v.Normal.Y, v.Normal.Z},
+                          {v.TextureCoordinate.X, v.TextureCoordinate.Y}});
+    }
+  }
+  Mesh() {}
+};
+
+// Same meaning as glMaterial.
+struct Material {
+  glm::vec3 ambient = glm::vec3(0.2f);
+  glm::vec3 diffuse = glm::vec3(0.8f);
+  glm::vec3 specular = glm::vec3(0.0f);
+  float shininess = 0.0f;
+};
+
+// Same meaning as glLight, w = 0 for directional lights. The position is in
+// world space.
+struct Light {
+  glm::vec4 position = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+  glm::vec3 ambient = glm::vec3(0.0f);
+  glm::vec3 diffuse = glm::vec3(1.0f);
+  glm::vec3 specular = glm::vec3(1.0f);
+};
+
+// Screen is split in tiles; triangles are binned into them and every tile is
+// rasterized by one thread, so tiles never share pixels.
+class Renderer {
+public:
+  // 0 threads uses every core.
+  Renderer(int width, int height, unsigned int threads = 0);
+  ~Renderer();
+
+  Renderer(const Renderer &) = delete;
+  Renderer &operator=(const Renderer &) = delete;
+
+  // Queues a draw, everything queued is rendered by render(). The mesh and
+  // texture must stay alive until then.
+  void draw(const Mesh &mesh, const glm::mat4 &model, const Texture *texture,
+            const Material &material);
+  void render(const glm::mat4 &view, const glm::mat4 &projection);
+
+  // Writes the last frame as a binary PPM.
+  bool write(const string &path) const;
+
+  int getWidth() const { return width; }
+  int getHeight() const { return height; }
+  unsigned int getThreads() const { return threadCount; }
+  const vector<uint32_t> &getPixels() const { return color; }
+
+  glm::vec3 clearColor = glm::vec3(1.0f);
+  glm::vec3 sceneAmbient = glm::vec3(0.2f); // GL_LIGHT_MODEL_AMBIENT
+  Light light;
+  bool cullBackFaces = true;
+
+  static const int TILE_SIZE = 64;
+
+private:
+  struct Draw {
+    const Mesh *mesh;
+    glm::mat4 model;
+    const Texture *texture;
+    Material material;
+    size_t firstVertex;   // Into clipVertices
+    size_t firstTriangle; // Over all draws
+  };
+
+  // After the vertex stage: clip space position, lit color, texture
+  // coordinate.
+  struct ClipVertex {
+    glm::vec4 position;
+    glm::vec3 color;
+    glm::vec2 texCoord;
+  };
+
+  // Screen space plane a * x + b * y + c for each interpolated value.
+  struct Plane {
+    float a, b, c;
+  };
+  struct Triangle {
+    Plane edges[3]; // Barycentric weights, all >= 0 inside
+    Plane depth, invW, s, t, r, g, b; // s, t, r, g and b are divided by w
+    int minX, minY, maxX, maxY;
+    const Texture *texture;
+  };
+
+  int width, height;
+  int tilesX, tilesY;
+  unsigned int threadCount;
+  vector<uint32_t> color;
+  vector<float> depth;
+
+  vector<Draw> draws;
+  size_t triangleTotal = 0;
+  vector<ClipVertex> clipVertices;
+  // Per thread: set up triangles and, per tile, indices into them.
+  vector<vector<Triangle>> triangles;
+  vector<vector<vector<unsigned int>>> bins;
+  atomic<unsigned int> nextTile;
+
+  // Thread pool, guarded by `poolMutex`.
+  mutex poolMutex;
+  condition_variable poolStart, poolDone;
+  function<void(unsigned int)> job;
+  unsigned long long generation = 0;
+  unsigned int running = 0;
+  bool stopping = false;
+  vector<thread> workers;
+
+  void workerLoop(unsigned int index);
+  // Runs `job` once on every thread, the caller being thread 0.
+  void parallel(const function<void(unsigned int)> &job);
+
+  void shadeVertices(unsigned int thread, const glm::mat4 &view,
+                     const glm::mat4 &projection, const glm::vec3 &lightEye,
+                     bool directional);
+  void setupTriangles(unsigned int thread);
+  void setup(unsigned int thread, const ClipVertex *vertices,
+             const Texture *texture);
+  void rasterizeTiles();
+  void rasterize(const Triangle &tri, int x0, int y0, int x1, int y1);
+};
+
+} // namespace software
@@ -0,0 +1,394 @@
+#include "scene.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace scene {
+
+namespace {
+
+// Fewer changed nodes than this are updated on the calling thread.
+const size_t PARALLEL_THRESHOLD = 32 * 1024;
+// Smallest amount of nodes handed to a thread at once.
+const size_t MIN_GRAIN = 4 * 1024;
+
+typedef pair<unsigned int, unsigned int> Range;
+
+// translate * rotate * scale, like glTranslatef, glRotatef, glScalef.
+glm::mat4 localMatrix(const glm::vec3 &translation, const glm::quat &rotation,
+                      const glm::vec3 &scale) {
+  glm::mat4 matrix = glm::mat4_cast(rotation);
+  matrix[0] *= scale.x;
+  matrix[1] *= scale.y;
+  matrix[2] *= scale.z;
+  matrix[3] = glm::vec4(translation, 1.0f);
+  return matrix;
+}
+
+template <typename T>
+void permute(vector<T> &values, const vector<unsigned int> &from) {
+  vector<T> permuted(from.size());
+  for (size_t i = 0; i < from.size(); i++) {
+    permuted[i] = values[from[i]];
+  }
+  values.swap(permuted);
+}
+
+bool readVec3(istream &stream, glm::vec3 &v) {
+  return static_cast<bool>(stream >> v.x >> v.y >> v.z);
+}
+
+} // namespace
+
+const unsigned int Graph::NONE;
+
+unsigned int Graph::add(const string &name, unsigned int parent) {
+  const unsigned int id = names.size();
+  const unsigned int position = ids.size();
+  names.push_back(name);
+  parentIds.push_back(parent);
+  positions.push_back(position);
+  byName.emplace(name, id);
+
+  // Appended for now, put in depth first order by the next update().
+  ids.push_back(id);
+  parents.push_back(parent == NONE ? NONE : positions[parent]);
+  subtreeEnds.push_back(position + 1);
+  translations.push_back(glm::vec3(0.0f));
+  rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+  scales.push_back(glm::vec3(1.0f));
+  locals.push_back(glm::mat4(1.0f));
+  worlds.push_back(glm::mat4(1.0f));
+  dirty.push_back(0);
+  markDirty(position);
+  orderChanged = true;
+  return id;
+}
+
+unsigned int Graph::find(const string &name) const {
+  auto it = byName.find(name);
+  return it != byName.end() ? it->second : NONE;
+}
+
+void Graph::setTranslation(unsigned int node, const glm::vec3 &translation) {
+  translations[positions[node]] = translation;
+  markDirty(positions[node]);
+}
+
+void Graph::setRotation(unsigned int node, const glm::quat &rotation) {
+  rotations[positions[node]] = rotation;
+  markDirty(positions[node]);
+}
+
+void Graph::setScale(unsigned int node, const glm::vec3 &scale) {
+  scales[positions[node]] = scale;
+  markDirty(positions[node]);
+}
+
+const glm::vec3 &Graph::getTranslation(unsigned int node) const {
+  return translations[positions[node]];
+}
+
+const glm::quat &Graph::getRotation(unsigned int node) const {
+  return rotations[positions[node]];
+}
+
+const glm::vec3 &Graph::getScale(unsigned int node) const {
+  return scales[positions[node]];
+}
+
+void Graph::addSpin(unsigned int node, float degreesPerSecond,
+                    const glm::vec3 &axis) {
+  spins.push_back(
+      {node, glm::normalize(axis), degreesPerSecond, 0.0f, getRotation(node)});
+}
+
+void Graph::animate(float dt) {
+  for (Spin &spin : spins) {
+    spin.angle = fmod(spin.angle + spin.degreesPerSecond * dt, 360.0f);
+    setRotation(spin.node, spin.rest * glm::angleAxis(glm::radians(spin.angle),
+                                                      spin.axis));
+  }
+}
+
+void Graph::markDirty(unsigned int position) {
+  if (!dirty[position]) {
+    dirty[position] = 1;
+    dirtyNodes.push_back(position);
+  }
+}
+
+void Graph::reorder() {
+  const unsigned int count = names.size();
+
+  // Children of every node, in the order they were added.
+  vector<unsigned int> firstChild(count + 1, 0), children(count);
+  for (unsigned int id = 0; id < count; id++) {
+    if (parentIds[id] != NONE) {
+      firstChild[parentIds[id] + 1]++;
+    }
+  }
+  for (unsigned int id = 0; id < count; id++) {
+    firstChild[id + 1] += firstChild[id];
+  }
+  vector<unsigned int> filled(firstChild.begin(), firstChild.end() - 1);
+  for (unsigned int id = 0; id < count; id++) {
+    if (parentIds[id] != NONE) {
+      children[filled[parentIds[id]]++] = id;
+    }
+  }
+
+  // Depth first, without recursion so deep chains fit on the stack.
+  vector<unsigned int> order, stack;
+  order.reserve(count);
+  for (unsigned int root = 0; root < count; root++) {
+    if (parentIds[root] != NONE) {
+      continue;
+    }
+    stack.push_back(root);
+    while (!stack.empty()) {
+      const unsigned int id = stack.back();
+      stack.pop_back();
+      order.push_back(id);
+      for (unsigned int c = firstChild[id + 1]; c > firstChild[id]; c--) {
+        stack.push_back(children[c - 1]);
+      }
+    }
+  }
+
+  vector<unsigned int> from(count);
+  for (unsigned int position = 0; position < count; position++) {
+    from[position] = positions[order[position]];
+    positions[order[position]] = position;
+  }
+  permute(translations, from);
+  permute(rotations, from);
+  permute(scales, from);
+  ids = order;
+
+  subtreeEnds.resize(count);
+  for (unsigned int position = 0; position < count; position++) {
+    const unsigned int parent = parentIds[ids[position]];
+    parents[position] = parent == NONE ? NONE : positions[parent];
+    subtreeEnds[position] = position + 1;
+  }
+  // Children come after their parent, so going backwards every subtree end is
+  // final before it reaches the parent.
+  for (unsigned int position = count; position-- > 0;) {
+    if (parents[position] != NONE) {
+      subtreeEnds[parents[position]] =
+          max(subtreeEnds[parents[position]], subtreeEnds[position]);
+    }
+  }
+
+  // Everything is recomputed once, every root covers its subtree.
+  dirty.assign(count, 1);
+  dirtyNodes.clear();
+  for (unsigned int position = 0; position < count;
+       position = subtreeEnds[position]) {
+    dirtyNodes.push_back(position);
+  }
+  orderChanged = false;
+}
+
+void Graph::updateRange(unsigned int begin, unsigned int end) {
+  for (unsigned int i = begin; i < end; i++) {
+    if (dirty[i]) {
+      locals[i] = localMatrix(translations[i], rotations[i], scales[i]);
+      dirty[i] = 0;
+    }
+    worlds[i] = parents[i] == NONE ? locals[i] : worlds[parents[i]] * locals[i];
+  }
+}
+
+void Graph::update(bool parallel) {
+  if (orderChanged) {
+    reorder();
+  }
+  updated = 0;
+  if (dirtyNodes.empty()) {
+    return;
+  }
+
+  // Subtrees to recompute. A changed node inside an earlier subtree is
+  // covered by it.
+  sort(dirtyNodes.begin(), dirtyNodes.end());
+  vector<Range> subtrees;
+  unsigned int covered = 0;
+  for (unsigned int position : dirtyNodes) {
+    if (position >= covered) {
+      covered = subtreeEnds[position];
+      subtrees.push_back({position, covered});
+      updated += covered - position;
+    }
+  }
+  dirtyNodes.clear();
+
+  const unsigned int cores = max(1u, thread::hardware_concurrency());
+  if (!parallel || cores == 1 || updated < PARALLEL_THRESHOLD) {
+    for (const Range &range : subtrees) {
+      updateRange(range.first, range.second);
+    }
+    return;
+  }
+
+  // Large subtrees are split: their root is updated here and the subtrees of
+  // its children become independent work.
+  const size_t grain = max(MIN_GRAIN, updated / (cores * 8));
+  vector<Range> work;
+  vector<Range> toSplit;
+  for (const Range &subtree : subtrees) {
+    toSplit.push_back(subtree);
+    while (!toSplit.empty()) {
+      const Range range = toSplit.back();
+      toSplit.pop_back();
+      if (range.second - range.first <= grain) {
+        work.push_back(range);
+        continue;
+      }
+      updateRange(range.first, range.first + 1);
+      for (unsigned int child = range.first + 1; child < range.second;
+           child = subtreeEnds[child]) {
+        toSplit.push_back({child, subtreeEnds[child]});
+      }
+    }
+  }
+
+  // Batches of about `grain` nodes, taken by the threads in any order.
+  vector<size_t> batches(1, 0);
+  size_t batchNodes = 0;
+  for (size_t i = 0; i < work.size(); i++) {
+    batchNodes += work[i].second - work[i].first;
+    if (batchNodes >= grain) {
+      batches.push_back(i + 1);
+      batchNodes = 0;
+    }
+  }
+  if (batches.back() != work.size()) {
+    batches.push_back(work.size());
+  }
+
+  atomic<size_t> nextBatch(0);
+  const auto worker = [&] {
+    size_t batch;
+    while ((batch = nextBatch++) + 1 < batches.size()) {
+      for (size_t i = batches[batch]; i < batches[batch + 1]; i++) {
+        updateRange(work[i].first, work[i].second);
+      }
+    }
+  };
+  const size_t threads = min<size_t>(cores, batches.size() - 1);
+  vector<future<void>> tasks;
+  for (size_t t = 1; t < threads; t++) {
+    tasks.push_back(async(launch::async, worker));
+  }
+  worker();
+  for (auto &task : tasks) {
+    task.get();
+  }
+}
+
+bool load(const string &path, Graph &graph) {
+  ifstream file(path);
+  if (!file) {
+    cout << "Failed to load scene: " << path << endl;
+    return false;
+  }
+
+  string line;
+  int lineNumber = 0;
+  while (getline(file, line)) {
+    lineNumber++;
+    const auto fail = [&](const string &message) {
+      cout << "Failed to load scene: " << path << ":" << lineNumber << ": "
+           << message << endl;
+      return false;
+    };
+
+    istringstream stream(line);
+    string keyword;
+    if (!(stream >> keyword) || keyword[0] == '#') {
+      continue;
+    }
+    if (keyword != "node") {
+      return fail("unknown keyword " + keyword);
+    }
+    string name, parentName;
+    if (!(stream >> name >> parentName)) {
+      return fail("expected node <name> <parent>");
+    }
+    if (graph.find(name) != Graph::NONE) {
+      return fail("duplicate node " + name);
+    }
+    unsigned int parent = Graph::NONE;
+    if (parentName != "-") {
+      parent = graph.find(parentName);
+      if (parent == Graph::NONE) {
+        return fail("unknown parent " + parentName);
+      }
+    }
+    const unsigned int node = graph.add(name, parent);
+
+    Drawable drawable = {node, "", "", ""};
+    float spinSpeed = 0.0f;
+    glm::vec3 spinAxis;
+    string property;
+    while (stream >> property) {
+      glm::vec3 v;
+      float f = 0.0f;
+      bool ok;
+      if (property == "translate") {
+        ok = readVec3(stream, v);
+        if (ok) {
+          graph.setTranslation(node, v);
+        }
+      } else if (property == "rotate") {
+        ok = stream >> f && readVec3(stream, v);
+        if (ok) {
+          // Rotations apply in the order they are written, like glRotatef.
+          graph.setRotation(node,
+                            graph.getRotation(node) *
+                                glm::angleAxis(glm::radians(f), glm::normalize(v)));
+        }
+      } else if (property == "scale") {
+        ok = readVec3(stream, v);
+        if (ok) {
+          graph.setScale(node, v);
+        }
+      } else if (property == "spin") {
+        ok = stream >> spinSpeed && readVec3(stream, spinAxis);
+      } else if (property == "light") {
+        ok = readVec3(stream, v) && stream >> f;
+        if (ok) {
+          graph.addLight({node, glm::vec4(v, f)});
+        }
+      } else if (property == "mesh") {
+        ok = static_cast<bool>(stream >> drawable.mesh);
+      } else if (property == "texture") {
+        ok = static_cast<bool>(stream >> drawable.texture);
+      } else if (property == "material") {
+        ok = static_cast<bool>(stream >> drawable.material);
+      } else {
+        return fail("unknown property " + property);
+      }
+      if (!ok) {
+        return fail("bad values for " + property);
+      }
+    }
+    if (spinSpeed != 0.0f) {
+      graph.addSpin(node, spinSpeed, spinAxis);
+    }
+    if (!drawable.mesh.empty()) {
+      graph.addDrawable(drawable);
+    }
+  }
+  return true;
+}
+
+} // namespace scene
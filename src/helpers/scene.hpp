@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+namespace scene {
+
+// Something to draw with the world matrix of `node`. Names are resolved by
+// whoever draws the scene.
+struct Drawable {
+  unsigned int node;
+  string mesh;
+  string texture;
+  string material;
+};
+
+// Same meaning as GL_POSITION, in the space of `node`.
+struct Light {
+  unsigned int node;
+  glm::vec4 position;
+};
+
+// Transform hierarchy. Nodes are stored depth first in flat arrays, so
+// parents come before their children and every subtree is a contiguous range.
+// World matrices are cached and only the subtrees under nodes that changed
+// are recomputed, in parallel when there are many of them.
+class Graph {
+public:
+  static const unsigned int NONE = ~0u;
+
+  // Returns the id of the new node. Ids never change, the parent must already
+  // be in the graph.
+  unsigned int add(const string &name, unsigned int parent = NONE);
+  // NONE if there is no node with that name.
+  unsigned int find(const string &name) const;
+  const string &getName(unsigned int node) const { return names[node]; }
+
+  void setTranslation(unsigned int node, const glm::vec3 &translation);
+  void setRotation(unsigned int node, const glm::quat &rotation);
+  void setScale(unsigned int node, const glm::vec3 &scale);
+  const glm::vec3 &getTranslation(unsigned int node) const;
+  const glm::quat &getRotation(unsigned int node) const;
+  const glm::vec3 &getScale(unsigned int node) const;
+
+  // Turns the node around `axis`, on top of its current rotation.
+  void addSpin(unsigned int node, float degreesPerSecond, const glm::vec3 &axis);
+  void addDrawable(const Drawable &drawable) { drawables.push_back(drawable); }
+  void addLight(const Light &light) { lights.push_back(light); }
+
+  // Advances the spins.
+  void animate(float dt);
+  // Recomputes the world matrices of changed nodes and their descendants.
+  void update(bool parallel = true);
+
+  // As of the last update().
+  const glm::mat4 &world(unsigned int node) const {
+    return worlds[positions[node]];
+  }
+
+  const vector<Drawable> &getDrawables() const { return drawables; }
+  const vector<Light> &getLights() const { return lights; }
+  size_t size() const { return names.size(); }
+  // World matrices recomputed by the last update().
+  size_t lastUpdated() const { return updated; }
+
+private:
+  struct Spin {
+    unsigned int node;
+    glm::vec3 axis;
+    float degreesPerSecond;
+    float angle;
+    glm::quat rest;
+  };
+
+  // Indexed by node id.
+  vector<string> names;
+  vector<unsigned int> parentIds;
+  vector<unsigned int> positions;
+  unordered_map<string, unsigned int> byName;
+
+  // Indexed by position in depth first order.
+  vector<unsigned int> ids;
+  vector<unsigned int> parents; // Position of the parent, NONE for roots
+  vector<unsigned int> subtreeEnds;
+  vector<glm::vec3> translations;
+  vector<glm::quat> rotations;
+  vector<glm::vec3> scales;
+  vector<glm::mat4> locals;
+  vector<glm::mat4> worlds;
+  vector<unsigned char> dirty;
+
+  vector<unsigned int> dirtyNodes; // Positions of nodes that changed
+  bool orderChanged = false;
+  size_t updated = 0;
+
+  vector<Spin> spins;
+  vector<Drawable> drawables;
+  vector<Light> lights;
+
+  void markDirty(unsigned int position);
+  void reorder();
+  void updateRange(unsigned int begin, unsigned int end);
+};
+
+// Reads a scene description, one node per line:
+//   node <name> <parent, or - for none> [properties]
+// with the properties
+//   translate x y z | rotate degrees x y z | scale x y z
+//   spin degreesPerSecond x y z | light x y z w
+//   mesh <name> | texture <name> | material <name>
+// Lines starting with # are comments.
+bool load(const string &path, Graph &graph);
+
+} // namespace scene
@@ -0,0 +1,359 @@
+#include "shader.hpp"
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <vector>
+
+// GL_ARB_get_program_binary is newer than the GL 2.1 glad was generated for,
+// so it is loaded by hand.
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+namespace {
+
+typedef void(APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize,
+                                             GLsizei *length,
+                                             GLenum *binaryFormat,
+                                             void *binary);
+typedef void(APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat,
+                                          const void *binary, GLsizei length);
+typedef void(APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname,
+                                              GLint value);
+
+GetProgramBinaryProc getProgramBinary = nullptr;
+ProgramBinaryProc programBinary = nullptr;
+ProgramParameteriProc programParameteri = nullptr;
+
+using Clock = chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start) {
+  return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+bool readFile(const string &path, string &contents) {
+  ifstream file(path, ios::binary);
+  if (!file) {
+    cout << "Failed to load shader: " << path << endl;
+    return false;
+  }
+  stringstream stream;
+  stream << file.rdbuf();
+  contents = stream.str();
+  return true;
+}
+
+// FNV-1a, good enough to tell sources apart.
+uint64_t sourceHash(const string &data) {
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : data) {
+    h = (h ^ c) * 1099511628211ull;
+  }
+  return h;
+}
+
+GLuint compile(GLenum type, const string &source, const string &name) {
+  GLuint shader = glCreateShader(type);
+  const char *data = source.data();
+  glShaderSource(shader, 1, &data, nullptr);
+  glCompileShader(shader);
+
+  GLint success;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (!success) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    cout << "Failed to compile "
+         << (type == GL_VERTEX_SHADER ? "vertex" : "fragment")
+         << " shader of " << name << ":\n"
+         << log << endl;
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+} // namespace
+
+ShaderManager::ShaderManager(const string &cacheDir) : cacheDir(cacheDir) {
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    const GLubyte *value = glGetString(name);
+    driver += value ? reinterpret_cast<const char *>(value) : "";
+    driver += '\n';
+  }
+
+  getProgramBinary = reinterpret_cast<GetProgramBinaryProc>(
+      glfwGetProcAddress("glGetProgramBinary"));
+  programBinary =
+      reinterpret_cast<ProgramBinaryProc>(glfwGetProcAddress("glProgramBinary"));
+  programParameteri = reinterpret_cast<ProgramParameteriProc>(
+      glfwGetProcAddress("glProgramParameteri"));
+
+  if (getProgramBinary && programBinary && programParameteri &&
+      glfwExtensionSupported("GL_ARB_get_program_binary")) {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    binarySupported = formats > 0;
+  }
+  if (binarySupported) {
+    mkdir(cacheDir.data(), 0755);
+  }
+}
+
+ShaderManager::~ShaderManager() {
+  for (auto &entry : programs) {
+    glDeleteProgram(entry.second.id);
+  }
+}
+
+unsigned int ShaderManager::load(const string &name, const string &vertexPath,
+                                 const string &fragmentPath) {
+  Program program;
+  program.vertexPath = vertexPath;
+  program.fragmentPath = fragmentPath;
+  program.vertexStamp = stamp(vertexPath);
+  program.fragmentStamp = stamp(fragmentPath);
+
+  string vertexSource, fragmentSource;
+  if (readFile(vertexPath, vertexSource) &&
+      readFile(fragmentPath, fragmentSource)) {
+    program.id = build(name, vertexSource, fragmentSource);
+  }
+
+  auto old = programs.find(name);
+  if (!program.id) {
+    // Watched anyway, so fixing the files loads it on the next reload.
+    if (old == programs.end()) {
+      programs[name] = program;
+    }
+    return 0;
+  }
+  readUniforms(program);
+  if (old != programs.end()) {
+    glDeleteProgram(old->second.id);
+  }
+  programs[name] = program;
+  return program.id;
+}
+
+unsigned int ShaderManager::program(const string &name) const {
+  auto it = programs.find(name);
+  return it != programs.end() ? it->second.id : 0;
+}
+
+int ShaderManager::uniform(const string &name, const string &uniformName) const {
+  auto it = programs.find(name);
+  if (it == programs.end()) {
+    return -1;
+  }
+  auto location = it->second.uniforms.find(uniformName);
+  return location != it->second.uniforms.end() ? location->second : -1;
+}
+
+unsigned int ShaderManager::reloadChanged() {
+  unsigned int reloaded = 0;
+  for (auto &entry : programs) {
+    Program &program = entry.second;
+    const FileStamp vertexStamp = stamp(program.vertexPath);
+    const FileStamp fragmentStamp = stamp(program.fragmentPath);
+    if (vertexStamp == program.vertexStamp &&
+        fragmentStamp == program.fragmentStamp) {
+      continue;
+    }
+    // Remember the new stamps even if the build fails, so a broken file is
+    // reported once instead of every frame. An editor that is still writing
+    // changes them again when it finishes.
+    program.vertexStamp = vertexStamp;
+    program.fragmentStamp = fragmentStamp;
+
+    string vertexSource, fragmentSource;
+    if (!readFile(program.vertexPath, vertexSource) ||
+        !readFile(program.fragmentPath, fragmentSource)) {
+      continue;
+    }
+    const unsigned int id = build(entry.first, vertexSource, fragmentSource);
+    if (!id) {
+      continue;
+    }
+    glDeleteProgram(program.id);
+    program.id = id;
+    readUniforms(program);
+    reloaded++;
+    cout << "Reloaded shader: " << entry.first << endl;
+  }
+  return reloaded;
+}
+
+unsigned int ShaderManager::build(const string &name, const string &vertexSource,
+                                  const string &fragmentSource) {
+  const uint64_t hash =
+      sourceHash(driver + '\0' + vertexSource + '\0' + fragmentSource);
+  char key[17];
+  snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+  const string cacheFile = name + "-" + key + ".bin";
+  const string cachePath = cacheDir + "/" + cacheFile;
+
+  if (binarySupported) {
+    const auto start = Clock::now();
+    const GLuint program = loadBinary(cachePath);
+    if (program) {
+      stats.cacheHits++;
+      stats.cacheLoadMs += elapsedMs(start);
+      return program;
+    }
+  }
+
+  const auto start = Clock::now();
+  const GLuint vertex = compile(GL_VERTEX_SHADER, vertexSource, name);
+  const GLuint fragment = compile(GL_FRAGMENT_SHADER, fragmentSource, name);
+  if (!vertex || !fragment) {
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vertex);
+  glAttachShader(program, fragment);
+  if (binarySupported) {
+    programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  glLinkProgram(program);
+  glDetachShader(program, vertex);
+  glDetachShader(program, fragment);
+  glDeleteShader(vertex);
+  glDeleteShader(fragment);
+
+  GLint success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    char log[1024];
+    glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+    cout << "Failed to link shader " << name << ":\n" << log << endl;
+    glDeleteProgram(program);
+    return 0;
+  }
+  stats.compiled++;
+  stats.compileMs += elapsedMs(start);
+
+  if (binarySupported && saveBinary(program, cachePath)) {
+    pruneCache(name, cacheFile);
+  }
+  return program;
+}
+
+unsigned int ShaderManager::loadBinary(const string &path) {
+  ifstream file(path, ios::binary);
+  if (!file) {
+    return 0;
+  }
+  uint32_t format;
+  if (!file.read(reinterpret_cast<char *>(&format), sizeof(format))) {
+    return 0;
+  }
+  vector<char> binary((istreambuf_iterator<char>(file)),
+                      istreambuf_iterator<char>());
+  if (binary.empty()) {
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  programBinary(program, format, binary.data(), binary.size());
+  GLint success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    // Stale or rejected by the driver, it gets rebuilt and overwritten.
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+bool ShaderManager::saveBinary(unsigned int program, const string &path) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return false;
+  }
+  vector<char> binary(length);
+  GLenum format;
+  getProgramBinary(program, length, &length, &format, binary.data());
+
+  // Write next to the target and rename, so a crash never leaves half a file.
+  const string temporary = path + ".tmp";
+  bool written;
+  {
+    ofstream file(temporary, ios::binary);
+    const uint32_t storedFormat = format;
+    file.write(reinterpret_cast<const char *>(&storedFormat),
+               sizeof(storedFormat));
+    file.write(binary.data(), length);
+    file.close();
+    written = static_cast<bool>(file);
+  }
+  if (!written || rename(temporary.data(), path.data()) != 0) {
+    cout << "Failed to write shader cache: " << path << endl;
+    remove(temporary.data());
+    return false;
+  }
+  return true;
+}
+
+void ShaderManager::pruneCache(const string &name, const string &keep) {
+  // Cache files are named "<name>-<16 hex digits>.bin".
+  const string prefix = name + "-";
+  const size_t length = prefix.size() + 16 + 4;
+  DIR *dir = opendir(cacheDir.data());
+  if (!dir) {
+    return;
+  }
+  while (const dirent *entry = readdir(dir)) {
+    const string file = entry->d_name;
+    if (file.size() == length && file != keep &&
+        file.compare(0, prefix.size(), prefix) == 0 &&
+        file.compare(length - 4, 4, ".bin") == 0 &&
+        file.find_first_not_of("0123456789abcdef", prefix.size()) ==
+            length - 4) {
+      remove((cacheDir + "/" + file).data());
+    }
+  }
+  closedir(dir);
+}
+
+ShaderManager::FileStamp ShaderManager::stamp(const string &path) {
+  FileStamp fileStamp;
+  struct stat info;
+  if (stat(path.data(), &info) == 0) {
+#ifdef __APPLE__
+    const timespec &modified = info.st_mtimespec;
+#else
+    const timespec &modified = info.st_mtim;
+#endif
+    fileStamp.modified = modified.tv_sec * 1000000000ll + modified.tv_nsec;
+    fileStamp.size = info.st_size;
+  }
+  return fileStamp;
+}
+
+void ShaderManager::readUniforms(Program &program) {
+  program.uniforms.clear();
+  GLint count = 0;
+  glGetProgramiv(program.id, GL_ACTIVE_UNIFORMS, &count);
+  for (GLint i = 0; i < count; i++) {
+    char name[256];
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(program.id, i, sizeof(name), nullptr, &size, &type,
+                       name);
+    program.uniforms[name] = glGetUniformLocation(program.id, name);
+  }
+}
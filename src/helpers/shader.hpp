@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+// Compiles and links the GLSL pairs in shaders/, keeps their uniform
+// locations and recompiles them when their files change. Linked programs are
+// cached on disk with GL_ARB_get_program_binary when the driver supports it.
+// Needs a current GL context.
+class ShaderManager {
+public:
+  struct Stats {
+    unsigned int compiled = 0;
+    unsigned int cacheHits = 0;
+    double compileMs = 0.0;   // Total time spent compiling and linking
+    double cacheLoadMs = 0.0; // Total time spent loading cached binaries
+  };
+
+  ShaderManager(const string &cacheDir = "shader_cache");
+  ~ShaderManager();
+
+  ShaderManager(const ShaderManager &) = delete;
+  ShaderManager &operator=(const ShaderManager &) = delete;
+
+  // Returns the program id, or 0 if it failed to compile or link. A failed
+  // program is still watched by reloadChanged().
+  unsigned int load(const string &name, const string &vertexPath,
+                    const string &fragmentPath);
+  // Current program id, it changes after a successful reload.
+  unsigned int program(const string &name) const;
+  // Location of a uniform, -1 if the program does not use it.
+  int uniform(const string &name, const string &uniformName) const;
+
+  // Recompiles programs whose files changed since they were loaded. A
+  // program that fails to build keeps its previous version.
+  unsigned int reloadChanged();
+
+  bool binaryCacheSupported() const { return binarySupported; }
+  const Stats &getStats() const { return stats; }
+
+private:
+  // Modification time in nanoseconds and size of a file. A save within the
+  // same second as the previous one still changes it.
+  struct FileStamp {
+    long long modified = 0;
+    long long size = -1;
+    bool operator==(const FileStamp &other) const {
+      return modified == other.modified && size == other.size;
+    }
+  };
+
+  struct Program {
+    unsigned int id = 0;
+    string vertexPath, fragmentPath;
+    FileStamp vertexStamp, fragmentStamp;
+    unordered_map<string, int> uniforms;
+  };
+
+  string cacheDir;
+  string driver; // Vendor, renderer and version, part of the cache key
+  bool binarySupported = false;
+  unordered_map<string, Program> programs;
+  Stats stats;
+
+  unsigned int build(const string &name, const string &vertexSource,
+                     const string &fragmentSource);
+  unsigned int loadBinary(const string &path);
+  bool saveBinary(unsigned int program, const string &path);
+  // Removes the binaries of older sources of the program, all but `keep`.
+  void pruneCache(const string &name, const string &keep);
+  static FileStamp stamp(const string &path);
+  static void readUniforms(Program &program);
+};
@@ -0,0 +1,510 @@
+#include "terrain.hpp"
+#include <algorithm>
+#include <cmath>
+#include <glad/glad.h>
+#include <iostream>
+#include <stb/stb_image.h>
+
+namespace terrain {
+
+float Heightmap::at(int x, int z) const {
+  x = max(0, min(x, width - 1));
+  z = max(0, min(z, depth - 1));
+  return heights[size_t(z) * width + x];
+}
+
+float Heightmap::sample(float worldX, float worldZ) const {
+  const float fx = (worldX - originX()) / spacing;
+  const float fz = (worldZ - originZ()) / spacing;
+  const int x = int(floor(fx));
+  const int z = int(floor(fz));
+  const float tx = fx - x;
+  const float tz = fz - z;
+  const float top = at(x, z) + (at(x + 1, z) - at(x, z)) * tx;
+  const float bottom = at(x, z + 1) + (at(x + 1, z + 1) - at(x, z + 1)) * tx;
+  return top + (bottom - top) * tz;
+}
+
+bool loadHeightmap(const string &path, float spacing, float maxHeight,
+                   Heightmap &heightmap) {
+  int width, depth, nrChannels;
+  heightmap.heights.clear();
+  if (stbi_is_16_bit(path.data())) {
+    unsigned short *data =
+        stbi_load_16(path.data(), &width, &depth, &nrChannels, 1);
+    if (data) {
+      heightmap.heights.assign(data, data + size_t(width) * depth);
+      for (float &h : heightmap.heights) {
+        h *= maxHeight / 65535.0f;
+      }
+    }
+    stbi_image_free(data);
+  } else {
+    unsigned char *data = stbi_load(path.data(), &width, &depth, &nrChannels, 1);
+    if (data) {
+      heightmap.heights.assign(data, data + size_t(width) * depth);
+      for (float &h : heightmap.heights) {
+        h *= maxHeight / 255.0f;
+      }
+    }
+    stbi_image_free(data);
+  }
+
+  if (heightmap.heights.empty()) {
+    cout << "Failed to load heightmap: " << path << endl;
+    return false;
+  }
+  heightmap.width = width;
+  heightmap.depth = depth;
+  heightmap.spacing = spacing;
+  return true;
+}
+
+static float hash(int x, int z, unsigned int seed) {
+  unsigned int h = unsigned(x) * 374761393u + unsigned(z) * 668265263u +
+                   seed * 2246822519u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  h ^= h >> 16;
+  return (h & 0xffffff) / float(0xffffff);
+}
+
+static float valueNoise(float x, float z, unsigned int seed) {
+  const int ix = int(floor(x));
+  const int iz = int(floor(z));
+  float tx = x - ix;
+  float tz = z - iz;
+  tx = tx * tx * (3.0f - 2.0f * tx);
+  tz = tz * tz * (3.0f - 2.0f * tz);
+  const float top =
+      hash(ix, iz, seed) + (hash(ix + 1, iz, seed) - hash(ix, iz, seed)) * tx;
+  const float bottom =
+      hash(ix, iz + 1, seed) +
+      (hash(ix + 1, iz + 1, seed) - hash(ix, iz + 1, seed)) * tx;
+  return top + (bottom - top) * tz;
+}
+
+Heightmap generateHeightmap(int size, float spacing, float maxHeight,
+                            float flatRadius, unsigned int seed) {
+  const int octaves = 6;
+  Heightmap heightmap;
+  heightmap.width = size;
+  heightmap.depth = size;
+  heightmap.spacing = spacing;
+  heightmap.heights.resize(size_t(size) * size);
+
+  for (int z = 0; z < size; z++) {
+    const float worldZ = heightmap.originZ() + z * spacing;
+    for (int x = 0; x < size; x++) {
+      const float worldX = heightmap.originX() + x * spacing;
+      float noise = 0.0f, amplitude = 1.0f, total = 0.0f;
+      float frequency = 1.0f / 256.0f;
+      for (int o = 0; o < octaves; o++) {
+        noise += amplitude *
+                 valueNoise(worldX * frequency, worldZ * frequency, seed + o);
+        total += amplitude;
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+      }
+
+      // Blend from flat ground to hills between one and two flat radii.
+      const float distance = sqrt(worldX * worldX + worldZ * worldZ);
+      float t = (distance - flatRadius) / max(flatRadius, 1.0f);
+      t = max(0.0f, min(t, 1.0f));
+      t = t * t * (3.0f - 2.0f * t);
+      heightmap.heights[size_t(z) * size + x] = noise / total * maxHeight * t;
+    }
+  }
+  return heightmap;
+}
+
+size_t Terrain::Tile::bytes() const {
+  return sizeof(Tile) + vertices.capacity() * sizeof(Vertex) +
+         heights.capacity() * sizeof(float);
+}
+
+Terrain::Terrain(shared_ptr<const Heightmap> heightmap, const Config &config)
+    : heightmap(heightmap), config(config) {
+  // Every LOD halves the grid of the previous one, the morph targets and
+  // skirts only line up on a power of two.
+  int quads = 2;
+  while (quads < this->config.tileQuads) {
+    quads *= 2;
+  }
+  this->config.tileQuads = quads;
+  // Every LOD but the last must have a coarser grid to morph into.
+  int maxLevels = 1;
+  while ((1 << maxLevels) <= this->config.tileQuads) {
+    maxLevels++;
+  }
+  this->config.lodLevels = max(1, min(this->config.lodLevels, maxLevels));
+
+  const int n = this->config.tileQuads;
+  tilesX = (heightmap->width - 1) / n;
+  tilesZ = (heightmap->depth - 1) / n;
+  gridSide = n + 1;
+
+  Tile tile;
+  tile.vertices.resize(size_t(gridSide) * gridSide + 4 * n);
+  tile.heights.resize(size_t(gridSide) * gridSide);
+  tileBytes = tile.bytes();
+
+  buildTopology();
+
+  unsigned int threads = this->config.workerThreads;
+  if (threads == 0) {
+    const unsigned int cores = thread::hardware_concurrency();
+    threads = cores > 1 ? cores - 1 : 1;
+  }
+  for (unsigned int i = 0; i < threads; i++) {
+    workers.emplace_back(&Terrain::workerLoop, this);
+  }
+}
+
+Terrain::~Terrain() {
+  {
+    lock_guard<mutex> lock(queueMutex);
+    stopping = true;
+  }
+  queueCondition.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void Terrain::buildTopology() {
+  const int n = config.tileQuads;
+  const unsigned int gridCount = gridSide * gridSide;
+
+  perimeter.clear();
+  for (int i = 0; i < n; i++) {
+    perimeter.push_back(i);
+  }
+  for (int j = 0; j < n; j++) {
+    perimeter.push_back(j * gridSide + n);
+  }
+  for (int i = n; i > 0; i--) {
+    perimeter.push_back(n * gridSide + i);
+  }
+  for (int j = n; j > 0; j--) {
+    perimeter.push_back(j * gridSide);
+  }
+
+  lodIndices.assign(config.lodLevels, {});
+  for (int lod = 0; lod < config.lodLevels; lod++) {
+    const int step = 1 << lod;
+    auto &indices = lodIndices[lod];
+
+    for (int j = 0; j < n; j += step) {
+      for (int i = 0; i < n; i += step) {
+        const unsigned int v00 = j * gridSide + i;
+        const unsigned int v10 = v00 + step;
+        const unsigned int v01 = v00 + step * gridSide;
+        const unsigned int v11 = v01 + step;
+        indices.insert(indices.end(), {v00, v01, v11, v00, v11, v10});
+      }
+    }
+
+    // Skirts hide the cracks between tiles at different LODs.
+    const unsigned int count = perimeter.size();
+    for (unsigned int p = 0; p < count; p += step) {
+      const unsigned int q = (p + step) % count;
+      const unsigned int a = perimeter[p], b = perimeter[q];
+      const unsigned int c = gridCount + q, d = gridCount + p;
+      indices.insert(indices.end(), {a, b, c, a, c, d});
+    }
+  }
+}
+
+unique_ptr<Terrain::Tile> Terrain::buildTile(int x, int z) const {
+  const Heightmap &map = *heightmap;
+  const int n = config.tileQuads;
+  auto tile = unique_ptr<Tile>(new Tile());
+  tile->x = x;
+  tile->z = z;
+  tile->vertices.resize(size_t(gridSide) * gridSide + perimeter.size());
+  tile->heights.resize(size_t(gridSide) * gridSide);
+  tile->boundsMin = glm::vec3(INFINITY);
+  tile->boundsMax = glm::vec3(-INFINITY);
+
+  for (int j = 0; j < gridSide; j++) {
+    const int gz = z * n + j;
+    const float worldZ = map.originZ() + gz * map.spacing;
+    for (int i = 0; i < gridSide; i++) {
+      const int gx = x * n + i;
+      const float worldX = map.originX() + gx * map.spacing;
+      const float h = map.at(gx, gz);
+      const glm::vec3 normal = glm::normalize(
+          glm::vec3(map.at(gx - 1, gz) - map.at(gx + 1, gz), 2.0f * map.spacing,
+                    map.at(gx, gz - 1) - map.at(gx, gz + 1)));
+
+      Vertex &vertex = tile->vertices[j * gridSide + i];
+      vertex.texCoord = glm::vec2(worldX, worldZ) * config.texScale;
+      vertex.normal = normal;
+      vertex.position = glm::vec3(worldX, h, worldZ);
+      tile->heights[j * gridSide + i] = h;
+
+      tile->boundsMin = glm::min(tile->boundsMin, glm::vec3(worldX, h, worldZ));
+      tile->boundsMax = glm::max(tile->boundsMax, glm::vec3(worldX, h, worldZ));
+    }
+  }
+
+  const size_t gridCount = tile->heights.size();
+  for (size_t p = 0; p < perimeter.size(); p++) {
+    Vertex &skirt = tile->vertices[gridCount + p];
+    skirt = tile->vertices[perimeter[p]];
+    skirt.position.y -= config.skirtDepth;
+  }
+  tile->boundsMin.y -= config.skirtDepth;
+  return tile;
+}
+
+float Terrain::boundsDistance(const Tile &tile, const glm::vec3 &point) const {
+  const glm::vec3 closest = glm::clamp(point, tile.boundsMin, tile.boundsMax);
+  return glm::distance(point, closest);
+}
+
+float Terrain::tileDistance(int x, int z, const glm::vec3 &point) const {
+  // Heights are unknown before the tile is built, so measure on the ground
+  // plane only. Streaming and eviction all use this, a tile kept by one must
+  // not be dropped by another.
+  const float size = config.tileQuads * heightmap->spacing;
+  const glm::vec2 tileMin(heightmap->originX() + x * size,
+                          heightmap->originZ() + z * size);
+  const glm::vec2 ground(point.x, point.z);
+  const glm::vec2 closest = glm::clamp(ground, tileMin, tileMin + size);
+  return glm::distance(ground, closest);
+}
+
+void Terrain::workerLoop() {
+  while (true) {
+    Request request;
+    {
+      unique_lock<mutex> lock(queueMutex);
+      queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+      if (stopping) {
+        return;
+      }
+      // Nearest request to the latest camera position first.
+      auto nearest = min_element(
+          queue.begin(), queue.end(), [this](const Request &a, const Request &b) {
+            return tileDistance(a.x, a.z, focus) < tileDistance(b.x, b.z, focus);
+          });
+      request = *nearest;
+      *nearest = queue.back();
+      queue.pop_back();
+    }
+
+    auto tile = buildTile(request.x, request.z);
+
+    lock_guard<mutex> lock(queueMutex);
+    finished.emplace_back(request, move(tile));
+  }
+}
+
+bool Terrain::evictFarthest(const glm::vec3 &cameraPosition,
+                            float minDistance) {
+  auto farthest = resident.end();
+  float farthestDistance = minDistance;
+  for (auto it = resident.begin(); it != resident.end(); ++it) {
+    const float distance =
+        tileDistance(it->second->x, it->second->z, cameraPosition);
+    if (distance > farthestDistance) {
+      farthest = it;
+      farthestDistance = distance;
+    }
+  }
+  if (farthest == resident.end()) {
+    return false;
+  }
+  residentBytes -= farthest->second->bytes();
+  resident.erase(farthest);
+  return true;
+}
+
+void Terrain::update(const glm::vec3 &cameraPosition) {
+  const float viewDistance = config.viewDistance;
+  const auto now = Clock::now();
+
+  vector<pair<Request, unique_ptr<Tile>>> done;
+  {
+    lock_guard<mutex> lock(queueMutex);
+    done.swap(finished);
+    focus = cameraPosition;
+    for (auto &result : done) {
+      inFlight.erase(key(result.first.x, result.first.z));
+    }
+  }
+
+  for (auto &result : done) {
+    const Request &request = result.first;
+    if (tileDistance(request.x, request.z, cameraPosition) > viewDistance) {
+      continue;
+    }
+    const double latencyMs =
+        chrono::duration<double, milli>(now - request.requestedAt).count();
+    latencySumMs += latencyMs;
+    maxLatencyMs = max(maxLatencyMs, latencyMs);
+    latencySamples++;
+
+    residentBytes += result.second->bytes();
+    resident[key(request.x, request.z)] = move(result.second);
+  }
+  // A burst of finished tiles can go over the budget too.
+  while (residentBytes > config.memoryBudget && !resident.empty()) {
+    evictFarthest(cameraPosition, -1.0f);
+  }
+
+  // Evict with some hysteresis so tiles on the border do not thrash.
+  for (auto it = resident.begin(); it != resident.end();) {
+    const Tile &tile = *it->second;
+    if (tileDistance(tile.x, tile.z, cameraPosition) > viewDistance * 1.1f) {
+      residentBytes -= it->second->bytes();
+      it = resident.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // Missing tiles inside the view distance, nearest first.
+  const float size = config.tileQuads * heightmap->spacing;
+  const int minX = max(0, int(floor((cameraPosition.x - viewDistance -
+                                      heightmap->originX()) / size)));
+  const int maxX = min(tilesX - 1, int(floor((cameraPosition.x + viewDistance -
+                                               heightmap->originX()) / size)));
+  const int minZ = max(0, int(floor((cameraPosition.z - viewDistance -
+                                      heightmap->originZ()) / size)));
+  const int maxZ = min(tilesZ - 1, int(floor((cameraPosition.z + viewDistance -
+                                               heightmap->originZ()) / size)));
+
+  vector<pair<float, pair<int, int>>> missing;
+  for (int z = minZ; z <= maxZ; z++) {
+    for (int x = minX; x <= maxX; x++) {
+      const float distance = tileDistance(x, z, cameraPosition);
+      if (distance <= viewDistance && !resident.count(key(x, z))) {
+        missing.push_back({distance, {x, z}});
+      }
+    }
+  }
+  sort(missing.begin(), missing.end());
+
+  {
+    lock_guard<mutex> lock(queueMutex);
+
+    // Drop queued requests that went out of range before being picked up.
+    for (size_t i = 0; i < queue.size();) {
+      if (tileDistance(queue[i].x, queue[i].z, cameraPosition) > viewDistance) {
+        inFlight.erase(key(queue[i].x, queue[i].z));
+        queue[i] = queue.back();
+        queue.pop_back();
+      } else {
+        i++;
+      }
+    }
+
+    size_t inFlightBytes = inFlight.size() * tileBytes;
+    for (const auto &candidate : missing) {
+      const int x = candidate.second.first, z = candidate.second.second;
+      if (inFlight.count(key(x, z))) {
+        continue;
+      }
+
+      // Make room by evicting tiles farther away than the candidate.
+      bool fits = true;
+      while (residentBytes + inFlightBytes + tileBytes > config.memoryBudget) {
+        if (!evictFarthest(cameraPosition, candidate.first)) {
+          fits = false;
+          break;
+        }
+      }
+      if (!fits) {
+        break;
+      }
+
+      queue.push_back({x, z, now});
+      inFlight.insert(key(x, z));
+      inFlightBytes += tileBytes;
+    }
+  }
+  queueCondition.notify_all();
+}
+
+void Terrain::morph(Tile &tile, int lod, const glm::vec3 &cameraPosition) const {
+  const int n = config.tileQuads;
+  const int step = 1 << lod;
+  const bool coarsest = lod == config.lodLevels - 1;
+  // Morph into the next LOD over the last 30% of this LOD's range.
+  const float morphEnd = config.lodDistance * float(step);
+  const float morphStart = 0.7f * morphEnd;
+  const auto height = [&](int i, int j) { return tile.heights[j * gridSide + i]; };
+
+  for (int j = 0; j <= n; j += step) {
+    for (int i = 0; i <= n; i += step) {
+      Vertex &vertex = tile.vertices[j * gridSide + i];
+      float h = height(i, j);
+      const bool oddX = (i / step) & 1;
+      const bool oddZ = (j / step) & 1;
+
+      if (!coarsest && (oddX || oddZ)) {
+        // Height this vertex has on the coarser grid, along the same diagonal
+        // the index buffers use.
+        float target;
+        if (oddX && oddZ) {
+          target = (height(i - step, j - step) + height(i + step, j + step)) / 2;
+        } else if (oddX) {
+          target = (height(i - step, j) + height(i + step, j)) / 2;
+        } else {
+          target = (height(i, j - step) + height(i, j + step)) / 2;
+        }
+        const float distance = glm::distance(
+            cameraPosition, glm::vec3(vertex.position.x, h, vertex.position.z));
+        float k = (distance - morphStart) / (morphEnd - morphStart);
+        k = max(0.0f, min(k, 1.0f));
+        h += (target - h) * k;
+      }
+      vertex.position.y = h;
+    }
+  }
+
+  const size_t gridCount = tile.heights.size();
+  for (size_t p = 0; p < perimeter.size(); p += step) {
+    tile.vertices[gridCount + p].position.y =
+        tile.vertices[perimeter[p]].position.y - config.skirtDepth;
+  }
+}
+
+void Terrain::draw(const glm::vec3 &cameraPosition) {
+  trianglesLastFrame = 0;
+  for (auto &entry : resident) {
+    Tile &tile = *entry.second;
+    const float distance = boundsDistance(tile, cameraPosition);
+    int lod = 0;
+    while (lod < config.lodLevels - 1 &&
+           distance >= config.lodDistance * float(1 << lod)) {
+      lod++;
+    }
+    morph(tile, lod, cameraPosition);
+
+    const auto &indices = lodIndices[lod];
+    glInterleavedArrays(GL_T2F_N3F_V3F, sizeof(Vertex),
+                        tile.vertices.data());
+    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT,
+                   indices.data());
+    trianglesLastFrame += indices.size() / 3;
+  }
+}
+
+Terrain::Stats Terrain::getStats() const {
+  Stats stats;
+  stats.residentTiles = resident.size();
+  stats.residentBytes = residentBytes;
+  stats.trianglesLastFrame = trianglesLastFrame;
+  stats.avgLatencyMs = latencySamples ? latencySumMs / latencySamples : 0.0;
+  stats.maxLatencyMs = maxLatencyMs;
+  {
+    lock_guard<mutex> lock(queueMutex);
+    stats.pendingTiles = inFlight.size();
+  }
+  return stats;
+}
+
+} // namespace terrain
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+namespace terrain {
+
+// Grid of heights centered on the origin, one sample every `spacing` units.
+struct Heightmap {
+  int width = 0; // Samples along X
+  int depth = 0; // Samples along Z
+  float spacing = 1.0f;
+  vector<float> heights;
+
+  // Height of a sample, indices are clamped to the map.
+  float at(int x, int z) const;
+  // Bilinear height at a world position.
+  float sample(float worldX, float worldZ) const;
+
+  float originX() const { return -(width - 1) * spacing / 2.0f; }
+  float originZ() const { return -(depth - 1) * spacing / 2.0f; }
+};
+
+// Loads a grayscale image (8 or 16 bits per channel) as a heightmap.
+bool loadHeightmap(const string &path, float spacing, float maxHeight,
+                   Heightmap &heightmap);
+
+// Fractal value noise heightmap of size x size samples. Terrain inside
+// `flatRadius` of the origin is kept at height 0 so the scene can sit on it.
+Heightmap generateHeightmap(int size, float spacing, float maxHeight,
+                            float flatRadius, unsigned int seed = 1337);
+
+// Same layout as GL_T2F_N3F_V3F, like objl::Vertex.
+struct Vertex {
+  glm::vec2 texCoord;
+  glm::vec3 normal;
+  glm::vec3 position;
+};
+
+// Tiled terrain with continuous (geomorphed) LOD. Tile meshes are built on
+// worker threads around the camera and evicted to stay inside a memory budget.
+class Terrain {
+public:
+  struct Config {
+    int tileQuads = 64; // Quads per tile side, rounded up to a power of two
+    int lodLevels = 4;
+    float lodDistance = 60.0f; // End of the finest LOD, doubles per level
+    float viewDistance = 600.0f;
+    float skirtDepth = 4.0f;
+    float texScale = 0.15f;
+    size_t memoryBudget = 48 * 1024 * 1024; // Bytes of resident tile meshes
+    unsigned int workerThreads = 0;         // 0: hardware concurrency - 1
+  };
+
+  struct Stats {
+    size_t residentTiles = 0;
+    size_t residentBytes = 0;
+    size_t pendingTiles = 0;
+    size_t trianglesLastFrame = 0;
+    double avgLatencyMs = 0.0; // Request to resident
+    double maxLatencyMs = 0.0;
+  };
+
+  Terrain(shared_ptr<const Heightmap> heightmap, const Config &config);
+  Terrain(shared_ptr<const Heightmap> heightmap)
+      : Terrain(heightmap, Config()) {}
+  ~Terrain();
+
+  Terrain(const Terrain &) = delete;
+  Terrain &operator=(const Terrain &) = delete;
+
+  // Integrates finished tiles, evicts far ones and requests missing ones.
+  void update(const glm::vec3 &cameraPosition);
+  // Draws resident tiles with the currently bound texture and material.
+  void draw(const glm::vec3 &cameraPosition);
+
+  float heightAt(float worldX, float worldZ) const {
+    return heightmap->sample(worldX, worldZ);
+  }
+  Stats getStats() const;
+
+private:
+  using Clock = chrono::steady_clock;
+
+  struct Tile {
+    int x, z;
+    glm::vec3 boundsMin, boundsMax;
+    // Full resolution grid followed by one skirt vertex per border vertex.
+    vector<Vertex> vertices;
+    // Unmorphed grid heights, positions are rewritten from these every draw.
+    vector<float> heights;
+    size_t bytes() const;
+  };
+
+  struct Request {
+    int x, z;
+    Clock::time_point requestedAt;
+  };
+
+  shared_ptr<const Heightmap> heightmap;
+  Config config;
+  int tilesX, tilesZ;
+  int gridSide; // Vertices per tile side
+  size_t tileBytes;
+
+  // Shared by every tile: one index buffer per LOD, including skirts.
+  vector<vector<unsigned int>> lodIndices;
+  // Grid indices around the border, clockwise seen from above.
+  vector<unsigned int> perimeter;
+
+  unordered_map<long long, unique_ptr<Tile>> resident;
+  size_t residentBytes = 0;
+  size_t trianglesLastFrame = 0;
+  double latencySumMs = 0.0;
+  double maxLatencyMs = 0.0;
+  size_t latencySamples = 0;
+
+  // Worker state, guarded by `queueMutex`.
+  mutable mutex queueMutex;
+  condition_variable queueCondition;
+  vector<Request> queue;
+  vector<pair<Request, unique_ptr<Tile>>> finished;
+  unordered_set<long long> inFlight; // Queued or being built
+  glm::vec3 focus;
+  bool stopping = false;
+  vector<thread> workers;
+
+  static long long key(int x, int z) {
+    return (static_cast<long long>(z) << 32) | static_cast<unsigned int>(x);
+  }
+
+  void buildTopology();
+  void workerLoop();
+  unique_ptr<Tile> buildTile(int x, int z) const;
+  // Ground plane distance, for streaming and eviction.
+  float tileDistance(int x, int z, const glm::vec3 &point) const;
+  // Distance to the tile's 3D bounds, for picking its LOD.
+  float boundsDistance(const Tile &tile, const glm::vec3 &point) const;
+  void morph(Tile &tile, int lod, const glm::vec3 &cameraPosition) const;
+  // Evicts the resident tile farthest from the camera, if it is farther than
+  // `minDistance`.
+  bool evictFarthest(const glm::vec3 &cameraPosition, float minDistance);
+};
+
+} // namespace terrain
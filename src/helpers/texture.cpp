@@ -1,8 +1,56 @@
 #include "texture.hpp"
 #include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <stb/stb_image.h>
 
+// ARB_sync and ARB_buffer_storage are newer than the GL 2.1 glad was
+// generated for, so they are loaded by hand.
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace {
+
+typedef GLsync(APIENTRYP FenceSyncProc)(GLenum condition, GLbitfield flags);
+typedef GLenum(APIENTRYP ClientWaitSyncProc)(GLsync sync, GLbitfield flags,
+                                             GLuint64 timeout);
+typedef void(APIENTRYP DeleteSyncProc)(GLsync sync);
+typedef void(APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size,
+                                          const void *data, GLbitfield flags);
+typedef void *(APIENTRYP MapBufferRangeProc)(GLenum target, GLintptr offset,
+                                             GLsizeiptr length,
+                                             GLbitfield access);
+
+FenceSyncProc fenceSync = nullptr;
+ClientWaitSyncProc clientWaitSync = nullptr;
+DeleteSyncProc deleteSync = nullptr;
+BufferStorageProc bufferStorage = nullptr;
+MapBufferRangeProc mapBufferRange = nullptr;
+
+bool signaled(void *fence) {
+  const GLenum result = clientWaitSync(static_cast<GLsync>(fence), 0, 0);
+  return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+double elapsedMs(chrono::steady_clock::time_point start,
+                 chrono::steady_clock::time_point end) {
+  return chrono::duration<double, milli>(end - start).count();
+}
+
+} // namespace
+
 namespace texture {
 
 unsigned int load(const string &path) {
@@ -34,4 +82,300 @@ unsigned int load(const string &path) {
 
 void free(unsigned int textureId) { glDeleteTextures(1, &textureId); }
 
+Streamer::Streamer(size_t frameBudget, unsigned int ringSize)
+    : slotSize(frameBudget), slots(max(1u, ringSize)) {
+  fenceSync =
+      reinterpret_cast<FenceSyncProc>(glfwGetProcAddress("glFenceSync"));
+  clientWaitSync = reinterpret_cast<ClientWaitSyncProc>(
+      glfwGetProcAddress("glClientWaitSync"));
+  deleteSync =
+      reinterpret_cast<DeleteSyncProc>(glfwGetProcAddress("glDeleteSync"));
+  bufferStorage =
+      reinterpret_cast<BufferStorageProc>(glfwGetProcAddress("glBufferStorage"));
+  mapBufferRange = reinterpret_cast<MapBufferRangeProc>(
+      glfwGetProcAddress("glMapBufferRange"));
+  fences = fenceSync && clientWaitSync && deleteSync &&
+           glfwExtensionSupported("GL_ARB_sync");
+
+  // A persistent mapping can only be rewritten once a fence says the GPU is
+  // done reading it.
+  if (fences && bufferStorage && mapBufferRange &&
+      glfwExtensionSupported("GL_ARB_buffer_storage")) {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    const GLsizeiptr size = slotSize * slots.size();
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    bufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+    mapped = static_cast<unsigned char *>(
+        mapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+    if (mapped) {
+      for (size_t i = 0; i < slots.size(); i++) {
+        slots[i].buffer = buffer;
+        slots[i].offset = i * slotSize;
+      }
+    } else {
+      glDeleteBuffers(1, &buffer);
+    }
+  }
+  if (!mapped) {
+    for (Slot &slot : slots) {
+      glGenBuffers(1, &slot.buffer);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, slotSize, nullptr, GL_STREAM_DRAW);
+    }
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  decoder = thread(&Streamer::decodeLoop, this);
+}
+
+Streamer::~Streamer() {
+  {
+    lock_guard<mutex> lock(decodeMutex);
+    stopping = true;
+  }
+  decodeCondition.notify_all();
+  decoder.join();
+
+  for (Slot &slot : slots) {
+    if (slot.fence) {
+      deleteSync(static_cast<GLsync>(slot.fence));
+    }
+  }
+  if (mapped) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slots[0].buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &slots[0].buffer);
+  } else {
+    for (Slot &slot : slots) {
+      glDeleteBuffers(1, &slot.buffer);
+    }
+  }
+}
+
+unsigned int Streamer::load(const string &path) {
+  unsigned int textureId;
+  glGenTextures(1, &textureId);
+  glBindTexture(GL_TEXTURE_2D, textureId);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  auto image = unique_ptr<Image>(new Image());
+  image->id = textureId;
+  image->path = path;
+  {
+    lock_guard<mutex> lock(decodeMutex);
+    toDecode.push_back(move(image));
+  }
+  decodeCondition.notify_one();
+  return textureId;
+}
+
+void Streamer::decodeLoop() {
+  while (true) {
+    unique_ptr<Image> image;
+    {
+      unique_lock<mutex> lock(decodeMutex);
+      decodeCondition.wait(lock,
+                           [this] { return stopping || !toDecode.empty(); });
+      if (stopping) {
+        return;
+      }
+      image = move(toDecode.front());
+      toDecode.pop_front();
+      decoding++;
+    }
+
+    int width, height, nrChannels;
+    unsigned char *data =
+        stbi_load(image->path.data(), &width, &height, &nrChannels, 4);
+    if (data) {
+      image->width = width;
+      image->height = height;
+      image->pixels.assign(data, data + size_t(width) * height * 4);
+    } else {
+      cout << "Failed to load texture: " << image->path << endl;
+    }
+    stbi_image_free(data);
+
+    lock_guard<mutex> lock(decodeMutex);
+    decoding--;
+    decoded.push_back(move(image));
+  }
+}
+
+void Streamer::retireFences() {
+  if (fences) {
+    // Fences signal in order, so the newest signaled one covers the rest.
+    for (Slot &slot : slots) {
+      if (slot.fence && signaled(slot.fence)) {
+        completedFrame = max(completedFrame, slot.frame);
+        deleteSync(static_cast<GLsync>(slot.fence));
+        slot.fence = nullptr;
+      }
+    }
+  } else if (frame > slots.size()) {
+    // Without fences assume the driver is at most one ring behind.
+    completedFrame = frame - slots.size();
+  }
+
+  for (size_t i = 0; i < waiting.size();) {
+    if (waiting[i]->frame <= completedFrame) {
+      resident.insert(waiting[i]->id);
+      waiting[i] = move(waiting.back());
+      waiting.pop_back();
+    } else {
+      i++;
+    }
+  }
+}
+
+void Streamer::update() {
+  const auto start = chrono::steady_clock::now();
+  const double frameMs = started ? elapsedMs(lastUpdate, start) : 0.0;
+  lastUpdate = start;
+  started = true;
+  frame++;
+
+  bool busy = !uploads.empty() || !waiting.empty();
+  {
+    lock_guard<mutex> lock(decodeMutex);
+    busy = busy || !toDecode.empty() || decoding > 0 || !decoded.empty();
+    for (auto &image : decoded) {
+      if (image->width > 0) {
+        uploads.push_back(move(image));
+      }
+    }
+    decoded.clear();
+  }
+  if (!busy) {
+    return;
+  }
+  longestFrameMs = max(longestFrameMs, frameMs);
+
+  retireFences();
+
+  // Rows that do not fit in a slot cannot be streamed, upload them directly.
+  // The driver copies client memory before returning, so they are usable
+  // right away and need no fence.
+  while (!uploads.empty() && size_t(uploads.front()->width) * 4 > slotSize) {
+    const Image &image = *uploads.front();
+    glBindTexture(GL_TEXTURE_2D, image.id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+    bytesUploaded += image.pixels.size();
+    resident.insert(image.id);
+    uploads.pop_front();
+  }
+
+  Slot &slot = slots[frame % slots.size()];
+  // A persistent slot still being read by the GPU is skipped this frame.
+  if (uploads.empty() || (mapped && slot.fence)) {
+    longestUpdateMs = max(longestUpdateMs,
+                          elapsedMs(start, chrono::steady_clock::now()));
+    return;
+  }
+
+  unsigned char *destination;
+  if (mapped) {
+    destination = mapped + slot.offset;
+  } else {
+    // Orphan the old storage so mapping never waits for the GPU.
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, slotSize, nullptr, GL_STREAM_DRAW);
+    destination = static_cast<unsigned char *>(
+        glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY));
+    if (!destination) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      return;
+    }
+  }
+
+  struct Chunk {
+    Image *image;
+    int row, rows;
+    size_t offset;
+  };
+  vector<Chunk> chunks;
+  size_t used = 0;
+  while (!uploads.empty()) {
+    Image &image = *uploads.front();
+    const size_t rowBytes = size_t(image.width) * 4;
+    const int rows =
+        min(image.height - image.nextRow, int((slotSize - used) / rowBytes));
+    if (rows == 0) {
+      break;
+    }
+    memcpy(destination + used, &image.pixels[image.nextRow * rowBytes],
+           rows * rowBytes);
+    chunks.push_back({&image, image.nextRow, rows, slot.offset + used});
+    used += rows * rowBytes;
+    image.nextRow += rows;
+
+    if (image.nextRow == image.height) {
+      image.frame = frame;
+      vector<unsigned char>().swap(image.pixels);
+      waiting.push_back(move(uploads.front()));
+      uploads.pop_front();
+    }
+  }
+  bytesUploaded += used;
+
+  if (!mapped) {
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  }
+
+  // Storage is allocated with no buffer bound, the null pointer would
+  // otherwise be read as an offset into it.
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  for (const Chunk &chunk : chunks) {
+    if (chunk.row == 0) {
+      glBindTexture(GL_TEXTURE_2D, chunk.image->id);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, chunk.image->width,
+                   chunk.image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+  for (const Chunk &chunk : chunks) {
+    glBindTexture(GL_TEXTURE_2D, chunk.image->id);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, chunk.row, chunk.image->width,
+                    chunk.rows, GL_RGBA, GL_UNSIGNED_BYTE,
+                    reinterpret_cast<void *>(chunk.offset));
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  slot.frame = frame;
+  if (fences) {
+    // Without persistent mapping the slot is reused before its fence
+    // signals. The new fence comes later, so it covers the old frame too.
+    if (slot.fence) {
+      deleteSync(static_cast<GLsync>(slot.fence));
+    }
+    slot.fence = fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  longestUpdateMs =
+      max(longestUpdateMs, elapsedMs(start, chrono::steady_clock::now()));
+}
+
+Streamer::Stats Streamer::getStats() const {
+  Stats stats;
+  {
+    lock_guard<mutex> lock(decodeMutex);
+    stats.pending = toDecode.size() + decoding + decoded.size();
+  }
+  stats.pending += uploads.size() + waiting.size();
+  stats.resident = resident.size();
+  stats.bytesUploaded = bytesUploaded;
+  stats.longestFrameMs = longestFrameMs;
+  stats.longestUpdateMs = longestUpdateMs;
+  stats.persistent = mapped != nullptr;
+  stats.fences = fences;
+  return stats;
+}
+
 } // namespace texture
@@ -1,5 +1,14 @@
 #pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 using namespace std;
 
 namespace texture {
@@ -7,4 +16,85 @@ namespace texture {
 unsigned int load(const string &path);
 void free(unsigned int textureId);
 
+// Loads textures without stalling the frame: images are decoded on a worker
+// thread and uploaded a few rows per frame through a ring of pixel buffer
+// objects. The ring is persistently mapped when the driver supports
+// ARB_buffer_storage, and ARB_sync fences tell when a texture is resident.
+// Needs a current GL context.
+class Streamer {
+public:
+  struct Stats {
+    size_t pending = 0; // Decoding, uploading or waiting for the GPU
+    size_t resident = 0;
+    size_t bytesUploaded = 0;
+    double longestFrameMs = 0.0;  // Between update() calls while streaming
+    double longestUpdateMs = 0.0; // Spent inside update()
+    bool persistent = false;
+    bool fences = false;
+  };
+
+  // Up to `frameBudget` bytes are uploaded per frame. Each of the
+  // `ringSize` buffers holds one frame of uploads.
+  Streamer(size_t frameBudget = 4 * 1024 * 1024, unsigned int ringSize = 3);
+  ~Streamer();
+
+  Streamer(const Streamer &) = delete;
+  Streamer &operator=(const Streamer &) = delete;
+
+  // Returns the texture id right away, its pixels arrive in later frames.
+  unsigned int load(const string &path);
+  // Call once per frame.
+  void update();
+
+  bool isResident(unsigned int textureId) const {
+    return resident.count(textureId) > 0;
+  }
+  Stats getStats() const;
+
+private:
+  struct Image {
+    unsigned int id;
+    string path;
+    int width = 0, height = 0;
+    vector<unsigned char> pixels; // RGBA8
+    int nextRow = 0;
+    unsigned long long frame = 0; // Frame that submitted the last rows
+  };
+
+  struct Slot {
+    unsigned int buffer = 0;
+    size_t offset = 0;
+    void *fence = nullptr;
+    unsigned long long frame = 0;
+  };
+
+  size_t slotSize;
+  vector<Slot> slots;
+  unsigned char *mapped = nullptr; // Persistent mapping of the whole ring
+  bool fences = false;
+
+  unsigned long long frame = 0;
+  unsigned long long completedFrame = 0; // GPU finished everything up to here
+  deque<unique_ptr<Image>> uploads;
+  vector<unique_ptr<Image>> waiting; // Submitted, GPU may still be copying
+  unordered_set<unsigned int> resident;
+  size_t bytesUploaded = 0;
+  double longestFrameMs = 0.0;
+  double longestUpdateMs = 0.0;
+  chrono::steady_clock::time_point lastUpdate;
+  bool started = false;
+
+  // Decoder thread state, guarded by `decodeMutex`.
+  mutable mutex decodeMutex;
+  condition_variable decodeCondition;
+  deque<unique_ptr<Image>> toDecode;
+  vector<unique_ptr<Image>> decoded;
+  size_t decoding = 0;
+  bool stopping = false;
+  thread decoder;
+
+  void decodeLoop();
+  void retireFences();
+};
+
 } // namespace texture
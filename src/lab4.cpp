@@ -1,62 +1,36 @@
 #include <glad/glad.h>
+#include "helpers/bvh.hpp"
 #include "helpers/camera.hpp"
+#include "helpers/house.hpp"
+#include "helpers/materials.hpp"
 #include <array>
 #include <cmath>
+#include <functional>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include "helpers/normals.hpp"
 #include <objLoader/OBJ_Loader.h>
+#include "helpers/scene.hpp"
+#include "helpers/terrain.hpp"
 #include "helpers/texture.hpp"
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 const GLuint WIDTH = 800, HEIGHT = 600;
 
-const GLfloat floorAmbient[4] = {0.4f, 0.4f, 0.4f, 1.0f};
-const GLfloat floorDiffuse[4] = {0.5f, 0.5f, 0.5f, 1.0f};
-const GLfloat floorSpecular[4] = {0.2f, 0.2f, 0.2f, 1.0f};
-const GLfloat floorShininess = 3.0f;
-
-const GLfloat wallAmbient[4] = {0.4f, 0.4f, 0.4f, 1.0f};
-const GLfloat wallDiffuse[4] = {0.2f, 0.2f, 0.2f, 1.0f};
-const GLfloat wallSpecular[4] = {0.6f, 0.6f, 0.6f, 1.0f};
-const GLfloat wallShininess = 13.0f;
-
-const GLfloat roofAmbient[4] = {0.4f, 0.4f, 0.4f, 1.0f};
-const GLfloat roofDiffuse[4] = {0.6f, 0.6f, 0.6f, 1.0f};
-const GLfloat roofSpecular[4] = {0.8f, 0.8f, 0.8f, 1.0f};
-const GLfloat roofShininess = 100.0f;
-
-const GLfloat leavesAmbient[4] = {0.4f, 0.4f, 0.4f, 1.0f};
-const GLfloat leavesDiffuse[4] = {0.3f, 0.3f, 0.3f, 1.0f};
-const GLfloat leavesSpecular[4] = {0.9f, 0.9f, 0.9f, 1.0f};
-const GLfloat leavesShininess = 8.0f;
-
-const GLfloat logAmbient[4] = {0.4f, 0.4f, 0.4f};
-const GLfloat logDiffuse[4] = {0.3f, 0.3f, 0.3f, 1.0f};
-const GLfloat logSpecular[4] = {0.2f, 0.2f, 0.2f, 1.0f};
-const GLfloat logShininess = 0.0f;
-
-const GLfloat Light0Pos[] = {0.0f, 30.0f, 50.0f, 0.0f};
-
 void frameBufferSizeCallback(GLFWwindow *window, int width, int height) {
   cout << "Width and height: " << width << ", " << height << "\n";
   glViewport(0, 0, width, height);
 }
 
 void setupLights() {
-  // Color values: red light.
-  GLfloat Light0Amb[] = {0.75f, 0.75f, 0.75f, 1.0f};
-  GLfloat Light0Dif[] = {0.9f, 0.9f, 0.9f, 1.0f};
-  GLfloat Light0Spec[] = {0.4f, 0.4f, 0.4f, 1.0f};
-  // Position values: puntual light.
-
-  // Light0 parameters.
-  glLightfv(GL_LIGHT0, GL_AMBIENT, Light0Amb);
-  glLightfv(GL_LIGHT0, GL_DIFFUSE, Light0Dif);
-  glLightfv(GL_LIGHT0, GL_SPECULAR, Light0Spec);
-  glLightfv(GL_LIGHT0, GL_POSITION, Light0Pos);
+  // Light0 parameters, the position is set every frame from the scene.
+  glLightfv(GL_LIGHT0, GL_AMBIENT, materials::light.ambient);
+  glLightfv(GL_LIGHT0, GL_DIFFUSE, materials::light.diffuse);
+  glLightfv(GL_LIGHT0, GL_SPECULAR, materials::light.specular);
 
   // Activate light.
   glEnable(GL_LIGHTING);
@@ -125,194 +99,77 @@ void drawGizmo() {
   glEnd();
 }
 
-void drawFloor(GLuint textureId, float width, float height) {
-  const float left = -width / 2.0f;
-  const float bottom = -height / 2.0f;
-  const float texProportion = 0.15f;
-
-  glMaterialfv(GL_FRONT, GL_AMBIENT, floorAmbient);
-  glMaterialfv(GL_FRONT, GL_DIFFUSE, floorDiffuse);
-  glMaterialfv(GL_FRONT, GL_SPECULAR, floorSpecular);
-  glMaterialf(GL_FRONT, GL_SHININESS, floorShininess);
-
-  glBindTexture(GL_TEXTURE_2D, textureId);
-  glBegin(GL_QUADS);
-  glNormal3f(0,1,0);
-  glTexCoord2f(left * texProportion, bottom *texProportion);
-  glVertex3f(left, 0, bottom);
-
-  glTexCoord2f(left * texProportion, (bottom + height) * texProportion);
-  glVertex3f(left, 0, bottom + height);
-
-  glTexCoord2f((left + width) * texProportion, (bottom + height) * texProportion);
-  glVertex3f(left + width, 0, bottom + height);
-
-  glTexCoord2f((left + width) * texProportion, bottom * texProportion);
-  glVertex3f(left + width, 0, bottom);
-  glEnd();
+void setMaterial(const materials::Material &material) {
+  glMaterialfv(GL_FRONT, GL_AMBIENT, material.ambient);
+  glMaterialfv(GL_FRONT, GL_DIFFUSE, material.diffuse);
+  glMaterialfv(GL_FRONT, GL_SPECULAR, material.specular);
+  glMaterialf(GL_FRONT, GL_SHININESS, material.shininess);
 }
 
-// Width: X
-// Height: Y
-// Length: Z
-void drawWalls(GLuint textureId, float x, float y, float z, float width, float height,
-               float length) {
-
-  glMaterialfv(GL_FRONT, GL_AMBIENT, wallAmbient);
-  glMaterialfv(GL_FRONT, GL_DIFFUSE, wallDiffuse);
-  glMaterialfv(GL_FRONT, GL_SPECULAR, wallSpecular);
-  glMaterialf(GL_FRONT, GL_SHININESS, wallShininess);
+void drawTerrain(terrain::Terrain &terrain, GLuint textureId,
+                 const glm::vec3 &cameraPosition) {
+  setMaterial(materials::table.at("floor"));
 
   glBindTexture(GL_TEXTURE_2D, textureId);
-  glBegin(GL_QUADS);
-
-  glTexCoord2f(0, 0);
-  glNormal3f(0,0,-1);
-  glVertex3f(x, y, z);
-  glTexCoord2f(0, 8);
-  glVertex3f(x, y + height, z);
-  glTexCoord2f(8, 8);
-  glVertex3f(x + width, y + height, z);
-  glTexCoord2f(8, 0);
-  glVertex3f(x + width, y, z);
-
-
-  glNormal3f(0,0,1);
-  glTexCoord2f(0, 0);
-  glVertex3f(x, y, z + length);
-  glTexCoord2f(8, 0);
-  glVertex3f(x + width, y, z + length);
-  glTexCoord2f(8, 8);
-  glVertex3f(x + width, y + height, z + length);
-  glTexCoord2f(0, 8);
-  glVertex3f(x, y + height, z + length);
-
-  glNormal3f(-1,0,0);
-  glTexCoord2f(0, 0);
-  glVertex3f(x, y, z);
-  glTexCoord2f(8, 0);
-  glVertex3f(x, y, z + length);
-  glTexCoord2f(8, 8);
-  glVertex3f(x , y + height, z + length);
-  glTexCoord2f(0, 8);
-  glVertex3f(x, y + height, z);
-
-  glNormal3f(1,0,0);
-  glTexCoord2f(0, 0);
-  glVertex3f(x + width, y, z);
-  glTexCoord2f(0, 8);
-  glVertex3f(x + width, y + height, z );
-  glTexCoord2f(8, 8);
-  glVertex3f(x + width, y + height, z + length);
-  glTexCoord2f(8, 0);
-  glVertex3f(x + width, y, z + length);
-
-  glEnd();
+  terrain.draw(cameraPosition);
 }
 
-void drawRoof(GLuint wallTextureId,GLuint roofTextureId, float x, float y, float z, float width, float height, float length) {
-  glMaterialfv(GL_FRONT, GL_AMBIENT, wallAmbient);
-  glMaterialfv(GL_FRONT, GL_DIFFUSE, wallDiffuse);
-  glMaterialfv(GL_FRONT, GL_SPECULAR, wallSpecular);
-  glMaterialf(GL_FRONT, GL_SHININESS, wallShininess);
-
-  glBindTexture(GL_TEXTURE_2D, wallTextureId) ;
-  glBegin(GL_TRIANGLES);
-  glNormal3f(0, 0, -1);
-  glTexCoord2f(0, 0);
-  glVertex3f(x, y, z);
-  glTexCoord2f(3, 6);
-  glVertex3f(x + width / 2.0f, y + height, z);
-  glTexCoord2f(6, 0);
-  glVertex3f(x + width, y, z);
-
-  glNormal3f(0, 0, 1);
-  glTexCoord2f(0, 0);
-  glVertex3f(x, y, z + length);
-  glTexCoord2f(6, 0);
-  glVertex3f(x + width, y, z + length);
-  glTexCoord2f(3, 6);
-  glVertex3f(x + width/ 2.0f, y + height, z + length);
-
-  glMaterialfv(GL_FRONT, GL_AMBIENT, roofAmbient);
-  glMaterialfv(GL_FRONT, GL_DIFFUSE, roofDiffuse);
-  glMaterialfv(GL_FRONT, GL_SPECULAR, roofSpecular);
-  glMaterialf(GL_FRONT, GL_SHININESS, roofShininess);
-
-  glEnd();
+// Vertices must have the GL_T2F_N3F_V3F layout.
+template <typename V, typename I>
+void drawMesh(const V &vertices, const I &indices) {
+  glInterleavedArrays(GL_T2F_N3F_V3F, sizeof(vertices[0]), vertices.data());
+  glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, indices.data());
+}
 
-  glBindTexture(GL_TEXTURE_2D, roofTextureId) ;
-  glBegin(GL_QUADS);
-
-  glm::vec3 one(0, 0, -length);
-  glm::vec3 two(width / 2.0f, height, 0);
-  glNormal3fv(&glm::normalize(glm::cross(two, one))[0]);
-  glTexCoord2f(0, 0);
-  glVertex3f(x, y, z); // 0
-  glTexCoord2f(0, 8);
-  glVertex3f(x, y, z + length); // 1
-  glTexCoord2f(8, 8);
-  glVertex3f(x + width /2.0f, y + height, z + length); // 2
-  glTexCoord2f(8, 0);
-  glVertex3f(x + width /2.0f, y + height, z);
-
-  one = glm::vec3(width / 2.0f, -height, 0);
-  two = glm::vec3(0, 0, length);
-  glNormal3fv(&glm::normalize(glm::cross(two, one))[0]);
-  glTexCoord2f(0, 0);
-  glVertex3f(x + width, y, z); // 0
-  glTexCoord2f(8, 0);
-  glVertex3f(x + width /2.0f, y + height, z); // 1
-  glTexCoord2f(8, 8);
-  glVertex3f(x + width /2.0f, y + height, z + length); // 2
-  glTexCoord2f(0, 8); 
-  glVertex3f(x + width, y, z + length);
+void drawHouse(const house::Mesh &mesh, GLuint wallTextureId,
+               GLuint roofTextureId) {
+  setMaterial(materials::table.at("wall"));
+  glBindTexture(GL_TEXTURE_2D, wallTextureId);
+  drawMesh(mesh.walls.vertices, mesh.walls.indices);
 
-  glEnd();
+  setMaterial(materials::table.at("roof"));
+  glBindTexture(GL_TEXTURE_2D, roofTextureId);
+  drawMesh(mesh.roof.vertices, mesh.roof.indices);
 }
 
-void drawHouse(GLuint wallTextureId, GLuint roofTextureId,  float x, float y, float z, float width, float wallHeight, float roofHeight, float length) {
-  drawWalls(wallTextureId, x,y,z,width, wallHeight, length);
-  drawRoof(wallTextureId, roofTextureId, x, y + wallHeight,z , width, roofHeight, length);
+// Draws every drawable of the scene with its cached world matrix.
+void drawScene(const scene::Graph &graph,
+               const unordered_map<string, function<void()>> &meshes,
+               const unordered_map<string, GLuint> &textureIds) {
+  for (const auto &drawable : graph.getDrawables()) {
+    auto mesh = meshes.find(drawable.mesh);
+    if (mesh == meshes.end()) {
+      continue;
+    }
+    glPushMatrix();
+    glMultMatrixf(&graph.world(drawable.node)[0][0]);
+    auto material = materials::table.find(drawable.material);
+    if (material != materials::table.end()) {
+      setMaterial(material->second);
+    }
+    auto textureId = textureIds.find(drawable.texture);
+    if (textureId != textureIds.end()) {
+      glBindTexture(GL_TEXTURE_2D, textureId->second);
+    }
+    mesh->second();
+    glPopMatrix();
+  }
 }
 
-template <typename V, typename I>
-void drawTree(GLuint leavesTextureId, GLuint barkTextureId, const V &cylinderVertices, const I &cylinderIndices,
-              const V &sphereVertices, const I &sphereIndices) {
-  glPushMatrix();
-  glTranslatef(10.0f, 0.0f, 10.0f);
-
-  glMaterialfv(GL_FRONT, GL_AMBIENT, leavesAmbient);
-  glMaterialfv(GL_FRONT, GL_DIFFUSE, leavesDiffuse);
-  glMaterialfv(GL_FRONT, GL_SPECULAR, leavesSpecular);
-  glMaterialf(GL_FRONT, GL_SHININESS, leavesShininess);
-
-  glPushMatrix();
-  glTranslatef(0.0f, 8.0f, 0.0f);
-  glScalef(0.2f, 0.2f, 0.2f);
-
-  glBindTexture(GL_TEXTURE_2D, leavesTextureId);
-  glInterleavedArrays(GL_T2F_N3F_V3F, sizeof(objl::Vertex),
-                      sphereVertices.data());
-  glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT,
-                 sphereIndices.data());
-
-  glPopMatrix();
-
-  glMaterialfv(GL_FRONT, GL_AMBIENT, logAmbient);
-  glMaterialfv(GL_FRONT, GL_DIFFUSE, logDiffuse);
-  glMaterialfv(GL_FRONT, GL_SPECULAR, logSpecular);
-  glMaterialf(GL_FRONT, GL_SHININESS, logShininess);
-  glPushMatrix();
-  // glTranslatef(0.0f, 2.0f,0.0f);
-  glScalef(1.0f, 3.0f, 1.0f);
-  glBindTexture(GL_TEXTURE_2D, barkTextureId);
-  glInterleavedArrays(GL_T2F_N3F_V3F, sizeof(objl::Vertex),
-                      cylinderVertices.data());
-  glDrawElements(GL_TRIANGLES, cylinderIndices.size(), GL_UNSIGNED_INT,
-                 cylinderIndices.data());
-  glPopMatrix();
-  glPopMatrix();
+// The same triangles drawHouse draws.
+void addHouseColliders(bvh::BVH &scene, const glm::mat4 &transform,
+                       const house::Mesh &mesh, unsigned int object) {
+  const auto at = [&](const house::Vertex &v) {
+    return glm::vec3(transform * glm::vec4(v.position, 1.0f));
+  };
+  for (const house::Part *part : {&mesh.walls, &mesh.roof}) {
+    const auto &vertices = part->vertices;
+    const auto &indices = part->indices;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      scene.addTriangle(at(vertices[indices[i]]), at(vertices[indices[i + 1]]),
+                        at(vertices[indices[i + 2]]), object);
+    }
+  }
 }
 
 int main() {
@@ -328,6 +185,11 @@ int main() {
     cout << "Failed to load file" << endl;
     return 1;
   }
+  // Smooth normals instead of the loader's flat ones, authored ones are kept.
+  if (loader.MissingNormals) {
+    normals::regenerate(loader.LoadedVertices, loader.LoadedIndices,
+                        loader.FlatNormals);
+  }
 
   auto sphereVertices = loader.LoadedVertices;
   auto sphereIndices = loader.LoadedIndices;
@@ -337,6 +199,10 @@ int main() {
     cout << "Failed to load file" << endl;
     return 1;
   }
+  if (loader.MissingNormals) {
+    normals::regenerate(loader.LoadedVertices, loader.LoadedIndices,
+                        loader.FlatNormals);
+  }
 
   auto cylinderVertices = loader.LoadedVertices;
   auto cylinderIndices = loader.LoadedIndices;
@@ -348,26 +214,107 @@ int main() {
   GLuint leavesTex;
   GLuint roofTex;
 
+  // Textures show up over the first frames instead of stalling startup.
+  texture::Streamer textures;
+  bool texturesReported = false;
   try {
-    barkTex = texture::load("textures/bark.jpg");
-    brickTex = texture::load("textures/brick.jpg");
-    grassTex = texture::load("textures/grass.jpg");
-    leavesTex = texture::load("textures/leaves.jpg");
-    roofTex = texture::load("textures/roof.jpg");
+    barkTex = textures.load("textures/bark.jpg");
+    brickTex = textures.load("textures/brick.jpg");
+    grassTex = textures.load("textures/grass.jpg");
+    leavesTex = textures.load("textures/leaves.jpg");
+    roofTex = textures.load("textures/roof.jpg");
   } catch (const std::exception &e) {
     std::cerr << e.what() << '\n';
     return 1;
   }
 
+  // Everything but the terrain comes from the scene description.
+  scene::Graph graph;
+  if (!scene::load("scenes/lab4.scene", graph)) {
+    return 1;
+  }
+  graph.update();
+
+  const house::Mesh houseMesh = house::build(10, 10, 5, 15);
+
+  const unordered_map<string, function<void()>> meshes = {
+      {"house", [&] { drawHouse(houseMesh, brickTex, roofTex); }},
+      {"sphere", [&] { drawMesh(sphereVertices, sphereIndices); }},
+      {"cylinder", [&] { drawMesh(cylinderVertices, cylinderIndices); }}};
+  const unordered_map<string, GLuint> textureIds = {{"bark", barkTex},
+                                                    {"brick", brickTex},
+                                                    {"grass", grassTex},
+                                                    {"leaves", leavesTex},
+                                                    {"roof", roofTex}};
+
+  // Terrain: 2km x 2km, flat around the house and the tree.
+  auto heightmap = make_shared<terrain::Heightmap>(
+      terrain::generateHeightmap(2049, 1.0f, 120.0f, 40.0f));
+  terrain::Terrain terrain(heightmap);
+
+  // Static geometry for camera collision and picking, objects are scene
+  // nodes.
+  bvh::BVH colliders;
+  for (const auto &drawable : graph.getDrawables()) {
+    const glm::mat4 &transform = graph.world(drawable.node);
+    if (drawable.mesh == "house") {
+      addHouseColliders(colliders, transform, houseMesh, drawable.node);
+    } else if (drawable.mesh == "sphere") {
+      colliders.addMesh(sphereVertices, sphereIndices, transform,
+                        drawable.node);
+    } else if (drawable.mesh == "cylinder") {
+      colliders.addMesh(cylinderVertices, cylinderIndices, transform,
+                        drawable.node);
+    }
+  }
+  colliders.build();
+
+  const float cameraRadius = 0.5f;
   Camera camera(window, 10.0f);
+  camera.setCollider([&](const glm::vec3 &from, const glm::vec3 &to) {
+    glm::vec3 position = colliders.slideSphere(from, to, cameraRadius);
+    // Stay above the ground.
+    position.y = max(position.y,
+                     terrain.heightAt(position.x, position.z) + cameraRadius);
+    return position;
+  });
+  bool wasPressed = false;
   // Main loop
-  double dt, currentTime, lastTime = 0.0, vel = 20.0, tmp = 0.0;
+  double dt, currentTime, lastTime = 0.0;
+  double lastReport = 0.0;
   while (!glfwWindowShouldClose(window)) {
     currentTime = glfwGetTime();
     dt = currentTime - lastTime;
     lastTime = currentTime;
 
     camera.computeMatrices(dt);
+    graph.animate(dt);
+    graph.update();
+
+    textures.update();
+    if (!texturesReported && textures.getStats().pending == 0) {
+      texturesReported = true;
+      const auto stats = textures.getStats();
+      cout << "Textures resident: " << stats.resident << ", longest frame "
+           << stats.longestFrameMs << " ms while streaming\n";
+    }
+
+    // Pick whatever is in the center of the screen.
+    const bool pressed =
+        glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if (pressed && !wasPressed) {
+      bvh::Ray ray;
+      ray.origin = camera.getPosition();
+      ray.direction = camera.getDirection();
+      bvh::Hit hit;
+      if (colliders.intersect(ray, hit)) {
+        cout << "Picked " << graph.getName(hit.object) << " (triangle "
+             << hit.triangle << ") at distance " << hit.t << "\n";
+      } else {
+        cout << "Picked nothing\n";
+      }
+    }
+    wasPressed = pressed;
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -380,15 +327,28 @@ int main() {
     // glMultMatrixf(&viewMat[0][0]);
     glMultMatrixf(&camera.getViewMatrix()[0][0]);
 
-    drawFloor(grassTex, 40, 40);
-    drawHouse(brickTex, roofTex, -10, 0, -7.5f, 10, 10, 5, 15);
-    drawTree(leavesTex, barkTex, cylinderVertices, cylinderIndices, sphereVertices, sphereIndices);
-
-    glPushMatrix();
-    tmp += vel * dt;
-    glRotatef(tmp, 0.0f, 1.0f, 0.0f);
-    glLightfv(GL_LIGHT0, GL_POSITION, Light0Pos);
-    glPopMatrix();
+    // Only GL_LIGHT0 is set up, it follows the first light of the scene.
+    if (!graph.getLights().empty()) {
+      const auto &light = graph.getLights().front();
+      glPushMatrix();
+      glMultMatrixf(&graph.world(light.node)[0][0]);
+      glLightfv(GL_LIGHT0, GL_POSITION, &light.position[0]);
+      glPopMatrix();
+    }
+
+    terrain.update(camera.getPosition());
+    drawTerrain(terrain, grassTex, camera.getPosition());
+    drawScene(graph, meshes, textureIds);
+
+    if (currentTime - lastReport > 2.0) {
+      lastReport = currentTime;
+      const auto stats = terrain.getStats();
+      cout << "Terrain: " << stats.residentTiles << " tiles, "
+           << stats.residentBytes / (1024.0 * 1024.0) << " MiB resident, "
+           << stats.pendingTiles << " pending, " << stats.trianglesLastFrame
+           << " triangles, latency avg " << stats.avgLatencyMs << " ms max "
+           << stats.maxLatencyMs << " ms\n";
+    }
 
     glfwSwapBuffers(window);
     glfwPollEvents();
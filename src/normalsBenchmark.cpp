@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <iostream>
+#include "helpers/benchmark.hpp"
+#include "helpers/normals.hpp"
+#include <objLoader/OBJ_Loader.h>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Regenerates the normals of a model that has them and reports how far they
+// are from the file's, in degrees.
+bool compareWithFile(const string &path, float creaseAngle) {
+  objl::Loader loader;
+  if (!loader.LoadFile(path)) {
+    cout << "Failed to load file" << endl;
+    return false;
+  }
+  vector<objl::Vertex> vertices = loader.LoadedVertices;
+  normals::Options options;
+  options.creaseAngle = creaseAngle;
+  const vector<glm::vec4> tangents =
+      normals::regenerate(vertices, loader.LoadedIndices, options);
+
+  double total = 0.0, worst = 0.0, worstDot = 0.0, worstLength = 0.0;
+  for (size_t i = 0; i < vertices.size(); i++) {
+    const objl::Vector3 &a = loader.LoadedVertices[i].Normal;
+    const objl::Vector3 &b = vertices[i].Normal;
+    const glm::vec3 expected = glm::normalize(glm::vec3(a.X, a.Y, a.Z));
+    const glm::vec3 normal(b.X, b.Y, b.Z);
+    const double error = glm::degrees(
+        acos(glm::clamp(glm::dot(expected, normal), -1.0f, 1.0f)));
+    total += error;
+    worst = max(worst, error);
+    // Tangents must be unit length and perpendicular to the normal.
+    const glm::vec3 tangent(tangents[i]);
+    worstDot = max(worstDot, double(fabs(glm::dot(tangent, normal))));
+    worstLength =
+        max(worstLength, double(fabs(glm::length(tangent) - 1.0f)));
+  }
+  cout << path << ": " << loader.LoadedIndices.size() / 3
+       << " triangles, normals off by " << total / vertices.size()
+       << " degrees on average, " << worst << " at most, tangent dot normal "
+       << worstDot << " at most, tangent length off by " << worstLength
+       << " at most\n";
+  if (worstDot > 1e-4 || worstLength > 1e-4) {
+    cout << "Failed tangent check: " << path << endl;
+    return false;
+  }
+  return true;
+}
+
+// Wavy grid of side x side quads stored like objl does, with a vertex for
+// every face corner.
+void generateGrid(int side, vector<glm::vec3> &positions,
+                  vector<glm::vec2> &texCoords, vector<unsigned int> &indices) {
+  const vector<unsigned int> grid = bench::gridIndices(side);
+  positions.resize(grid.size());
+  texCoords.resize(grid.size());
+  indices.resize(grid.size());
+  for (size_t corner = 0; corner < grid.size(); corner++) {
+    const int x = grid[corner] % (side + 1), z = grid[corner] / (side + 1);
+    positions[corner] = bench::gridPosition(side, x, z);
+    texCoords[corner] = glm::vec2(x, z) * 0.1f;
+    indices[corner] = corner;
+  }
+}
+
+void benchmark(int side) {
+  vector<glm::vec3> positions;
+  vector<glm::vec2> texCoords;
+  vector<unsigned int> indices;
+  generateGrid(side, positions, texCoords, indices);
+
+  const unsigned int cores = max(1u, thread::hardware_concurrency());
+  cout << "grid " << side << "x" << side << ": " << indices.size() / 3
+       << " triangles\n";
+  for (unsigned int threads : {1u, cores}) {
+    normals::Options options;
+    options.threads = threads;
+    const auto start = chrono::steady_clock::now();
+    const normals::Result result =
+        normals::generate(positions, texCoords, indices, options);
+    const double elapsed = bench::seconds(start);
+    cout << "  " << threads << " threads: " << elapsed * 1000.0 << " ms ("
+         << result.weldMs << " weld, " << result.normalsMs << " normals, "
+         << result.tangentsMs << " tangents), "
+         << indices.size() / 3 / elapsed / 1e6 << " M triangles/s\n";
+    if (cores == 1) {
+      break;
+    }
+  }
+}
+
+int main() {
+  // Smooth sphere, and a cube whose edges are all creases.
+  if (!compareWithFile("objects/sphere.obj", 180.0f) ||
+      !compareWithFile("objects/cube.obj", 60.0f)) {
+    return 1;
+  }
+  for (int side : {708, 1415}) {
+    benchmark(side);
+  }
+}
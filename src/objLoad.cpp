@@ -1,5 +1,7 @@
 #include <glad/glad.h>
 #include "helpers/camera.hpp"
+#include "helpers/normals.hpp"
+#include "helpers/shader.hpp"
 #include <GLFW/glfw3.h>
 #include <array>
 #include <cmath>
@@ -27,8 +29,11 @@ GLFWwindow *initGL() {
 
   // GLFW setup
   glfwWindowHint(GLFW_SAMPLES, 4); // Anti aliasing
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+  // The shaders are GLSL 330, the gizmo and matrices still use the fixed
+  // function pipeline, so this needs a 3.3 compatibility profile.
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
 
   GLFWwindow *window =
       glfwCreateWindow(WIDTH, HEIGHT, "Test window", nullptr, nullptr);
@@ -84,6 +89,11 @@ int main() {
     cout << "Failed to load file" << endl;
     return 1;
   }
+  // Smooth normals instead of the loader's flat ones, authored ones are kept.
+  if (loader.MissingNormals) {
+    normals::regenerate(loader.LoadedVertices, loader.LoadedIndices,
+                        loader.FlatNormals);
+  }
 
   const auto &vertices = loader.LoadedVertices;
   const auto &indices = loader.LoadedIndices;
@@ -94,6 +104,28 @@ int main() {
   glm::mat4 viewMat = glm::lookAt(glm::vec3{10, 10, 10}, {0, 0, 0}, {0, 1, 0});
   glm::mat4 modelMat = glm::mat4(1.0f);
 
+  // Every shader pair in shaders/, the cube is drawn with objLoad.
+  ShaderManager shaders;
+  const char *shaderNames[][3] = {
+      {"default", "shaders/vshader.glsl", "shaders/fshader.glsl"},
+      {"minimal", "shaders/minimal_v.glsl", "shaders/minimal_f.glsl"},
+      {"lab1", "shaders/lab1_v.glsl", "shaders/lab1_f.glsl"},
+      {"lab2_inv", "shaders/lab2_inv_v.glsl", "shaders/lab2_inv_f.glsl"},
+      {"lab2_one_color", "shaders/lab2_one_color_v.glsl",
+       "shaders/lab2_one_color_f.glsl"},
+      {"objLoad", "shaders/objLoad_v.glsl", "shaders/objLoad_f.glsl"}};
+  const double shadersStart = glfwGetTime();
+  for (const auto &shader : shaderNames) {
+    shaders.load(shader[0], shader[1], shader[2]);
+  }
+  const auto &shaderStats = shaders.getStats();
+  cout << "Shaders ready in " << (glfwGetTime() - shadersStart) * 1000.0
+       << " ms: " << shaderStats.compiled << " compiled ("
+       << shaderStats.compileMs << " ms), " << shaderStats.cacheHits
+       << " from cache (" << shaderStats.cacheLoadMs << " ms)"
+       << (shaders.binaryCacheSupported() ? "" : ", binary cache unsupported")
+       << "\n";
+
   Camera camera(window, 10.0f);
   // Main loop
   double dt, currentTime, lastTime = 0.0;
@@ -117,9 +149,37 @@ int main() {
 
     drawGizmo();
 
-    glInterleavedArrays(GL_T2F_N3F_V3F, sizeof(objl::Vertex), vertices.data());
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT,
-                   indices.data());
+    shaders.reloadChanged();
+    const GLuint program = shaders.program("objLoad");
+    if (program) {
+      const glm::mat4 mvp =
+          camera.getProjectionMatrix() * camera.getViewMatrix() * modelMat;
+      glUseProgram(program);
+      glUniformMatrix4fv(shaders.uniform("objLoad", "mvp"), 1, GL_FALSE,
+                         &mvp[0][0]);
+      glUniform3f(shaders.uniform("objLoad", "inColor"), 0.2f, 0.5f, 0.8f);
+
+      glEnableVertexAttribArray(0);
+      glEnableVertexAttribArray(1);
+      glEnableVertexAttribArray(2);
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(objl::Vertex),
+                            &vertices[0].Position);
+      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(objl::Vertex),
+                            &vertices[0].Normal);
+      glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(objl::Vertex),
+                            &vertices[0].TextureCoordinate);
+      glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT,
+                     indices.data());
+      glDisableVertexAttribArray(0);
+      glDisableVertexAttribArray(1);
+      glDisableVertexAttribArray(2);
+      glUseProgram(0);
+    } else {
+      glInterleavedArrays(GL_T2F_N3F_V3F, sizeof(objl::Vertex),
+                          vertices.data());
+      glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT,
+                     indices.data());
+    }
 
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -0,0 +1,94 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include "helpers/benchmark.hpp"
+#include "helpers/scene.hpp"
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+const int FRAMES = 20;
+const float MOVING = 0.01f;
+
+// Every node hangs from a random earlier node, which gives a few deep and
+// very large subtrees.
+void generateRandom(scene::Graph &graph, unsigned int count, mt19937 &rng) {
+  graph.add("0");
+  for (unsigned int i = 1; i < count; i++) {
+    graph.add(to_string(i), uniform_int_distribution<unsigned int>(0, i - 1)(rng));
+  }
+}
+
+// Complete tree with 8 children per node, most nodes are leaves.
+void generateWide(scene::Graph &graph, unsigned int count, mt19937 &) {
+  graph.add("0");
+  for (unsigned int i = 1; i < count; i++) {
+    graph.add(to_string(i), (i - 1) / 8);
+  }
+}
+
+// Average update() time, in milliseconds, of `FRAMES` frames where the
+// `moving` nodes change. Also returns how many world matrices were updated.
+double updateTime(scene::Graph &graph, const vector<unsigned int> &moving,
+                  bool parallel, size_t &updated) {
+  double total = 0.0;
+  for (int frame = 0; frame < FRAMES; frame++) {
+    const glm::quat rotation =
+        glm::angleAxis(glm::radians(float(frame)), glm::vec3(0, 1, 0));
+    for (unsigned int node : moving) {
+      graph.setRotation(node, rotation);
+    }
+    const auto start = chrono::steady_clock::now();
+    graph.update(parallel);
+    total += bench::seconds(start);
+    updated = graph.lastUpdated();
+  }
+  return total / FRAMES * 1000.0;
+}
+
+void benchmark(const string &name,
+               void (*generate)(scene::Graph &, unsigned int, mt19937 &),
+               unsigned int count) {
+  mt19937 rng(42);
+  scene::Graph graph;
+  generate(graph, count, rng);
+  for (unsigned int node = 0; node < count; node++) {
+    graph.setTranslation(node, glm::vec3(1.0f, 0.5f, 0.0f));
+    graph.setScale(node, glm::vec3(0.999f));
+  }
+  graph.update();
+
+  // Only the root moves, which recomputes every node, like drawing with
+  // glPushMatrix every frame.
+  size_t fullUpdated;
+  const double fullSerial = updateTime(graph, {0}, false, fullUpdated);
+  const double fullParallel = updateTime(graph, {0}, true, fullUpdated);
+
+  vector<unsigned int> moving;
+  for (unsigned int node = 0; node < count; node++) {
+    if (uniform_real_distribution<float>()(rng) < MOVING) {
+      moving.push_back(node);
+    }
+  }
+  size_t movingUpdated;
+  const double movingSerial = updateTime(graph, moving, false, movingUpdated);
+  const double movingParallel = updateTime(graph, moving, true, movingUpdated);
+
+  cout << name << ", " << count << " nodes\n"
+       << "  root moved, all recomputed (" << fullUpdated << " updated): " << fullSerial
+       << " ms serial, " << fullParallel << " ms parallel\n"
+       << "  " << moving.size() << " moving (" << movingUpdated
+       << " updated): " << movingSerial << " ms serial, " << movingParallel
+       << " ms parallel\n";
+}
+
+int main() {
+  cout << "Transform update, " << max(1u, thread::hardware_concurrency())
+       << " threads, average of " << FRAMES << " frames\n";
+  for (unsigned int count : {100000u, 1000000u}) {
+    benchmark("random tree", generateRandom, count);
+    benchmark("wide tree", generateWide, count);
+  }
+}
@@ -0,0 +1,255 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <objLoader/OBJ_Loader.h>
+#include "helpers/house.hpp"
+#include "helpers/materials.hpp"
+#include "helpers/rasterizer.hpp"
+#include "helpers/scene.hpp"
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Renders scenes/lab4.scene on the CPU, no window or GL context needed.
+//   softwareRender [frames]   writes frames as frame_000.ppm, frame_001.ppm...
+//   softwareRender --benchmark
+
+const int WIDTH = 800, HEIGHT = 600;
+
+software::Material material(const materials::Material &m) {
+  software::Material material;
+  material.ambient = glm::vec3(m.ambient[0], m.ambient[1], m.ambient[2]);
+  material.diffuse = glm::vec3(m.diffuse[0], m.diffuse[1], m.diffuse[2]);
+  material.specular = glm::vec3(m.specular[0], m.specular[1], m.specular[2]);
+  material.shininess = m.shininess;
+  return material;
+}
+
+// Same materials as lab4.
+unordered_map<string, software::Material> makeMaterials() {
+  unordered_map<string, software::Material> result;
+  for (const auto &entry : materials::table) {
+    result[entry.first] = material(entry.second);
+  }
+  return result;
+}
+const unordered_map<string, software::Material> sceneMaterials =
+    makeMaterials();
+
+const char *textureNames[] = {"bark", "brick", "grass", "leaves", "roof"};
+typedef unordered_map<string, software::Texture> Textures;
+
+struct Meshes {
+  software::Mesh floor, walls, roof, sphere, cylinder;
+};
+
+void addTriangle(software::Mesh &mesh, const glm::vec3 &normal,
+                 const glm::vec3 *positions, const glm::vec2 *texCoords,
+                 int count = 3) {
+  const unsigned int first = mesh.vertices.size();
+  for (int i = 0; i < count; i++) {
+    mesh.vertices.push_back({positions[i], normal, texCoords[i]});
+  }
+  for (int i = 1; i + 1 < count; i++) {
+    mesh.indices.insert(mesh.indices.end(), {first, first + i, first + i + 1});
+  }
+}
+
+void addQuad(software::Mesh &mesh, const glm::vec3 &normal,
+             const glm::vec3 (&positions)[4], const glm::vec2 (&texCoords)[4]) {
+  addTriangle(mesh, normal, positions, texCoords, 4);
+}
+
+// Flat ground, split so most triangles stay inside the guard band.
+software::Mesh makeFloor(float size, int divisions) {
+  const float texProportion = 0.15f;
+  const float step = size / divisions;
+  software::Mesh mesh;
+  for (int z = 0; z < divisions; z++) {
+    for (int x = 0; x < divisions; x++) {
+      const float left = -size / 2.0f + x * step;
+      const float bottom = -size / 2.0f + z * step;
+      const glm::vec3 p[4] = {{left, 0, bottom},
+                              {left, 0, bottom + step},
+                              {left + step, 0, bottom + step},
+                              {left + step, 0, bottom}};
+      glm::vec2 t[4];
+      for (int i = 0; i < 4; i++) {
+        t[i] = glm::vec2(p[i].x, p[i].z) * texProportion;
+      }
+      addQuad(mesh, {0, 1, 0}, p, t);
+    }
+  }
+  return mesh;
+}
+
+software::Mesh makeMesh(const house::Part &part) {
+  software::Mesh mesh;
+  mesh.indices = part.indices;
+  mesh.vertices.reserve(part.vertices.size());
+  for (const auto &v : part.vertices) {
+    mesh.vertices.push_back({v.position, v.normal, v.texCoord});
+  }
+  return mesh;
+}
+
+// Orbits the house, with the same projection as Camera.
+void drawScene(software::Renderer &renderer, const scene::Graph &graph,
+               const Meshes &meshes, const Textures &textures, float time) {
+  const float aspect = float(renderer.getWidth()) / renderer.getHeight();
+  const glm::mat4 projection =
+      glm::perspective(glm::radians(45.0f), aspect, 0.1f, 1000.0f);
+  const float angle = time * 0.5f;
+  const glm::vec3 position(35.0f * sin(angle), 15.0f, 35.0f * cos(angle));
+  const glm::mat4 view =
+      glm::lookAt(position, glm::vec3(0.0f, 4.0f, 0.0f), glm::vec3(0, 1, 0));
+
+  if (!graph.getLights().empty()) {
+    const auto &light = graph.getLights().front();
+    renderer.light.position = graph.world(light.node) * light.position;
+  }
+  const auto color = [](const float *rgba) {
+    return glm::vec3(rgba[0], rgba[1], rgba[2]);
+  };
+  renderer.light.ambient = color(materials::light.ambient);
+  renderer.light.diffuse = color(materials::light.diffuse);
+  renderer.light.specular = color(materials::light.specular);
+
+  renderer.draw(meshes.floor, glm::mat4(1.0f), &textures.at("grass"),
+                sceneMaterials.at("floor"));
+  for (const auto &drawable : graph.getDrawables()) {
+    const glm::mat4 &model = graph.world(drawable.node);
+    if (drawable.mesh == "house") {
+      renderer.draw(meshes.walls, model, &textures.at("brick"),
+                    sceneMaterials.at("wall"));
+      renderer.draw(meshes.roof, model, &textures.at("roof"),
+                    sceneMaterials.at("roof"));
+      continue;
+    }
+    const software::Mesh *mesh = drawable.mesh == "sphere"     ? &meshes.sphere
+                                 : drawable.mesh == "cylinder" ? &meshes.cylinder
+                                                               : nullptr;
+    if (!mesh) {
+      continue;
+    }
+    auto texture = textures.find(drawable.texture);
+    auto material = sceneMaterials.find(drawable.material);
+    renderer.draw(*mesh, model,
+                  texture != textures.end() ? &texture->second : nullptr,
+                  material != sceneMaterials.end() ? material->second
+                                              : software::Material());
+  }
+
+  renderer.render(view, projection);
+}
+
+void benchmark(scene::Graph &graph, const Meshes &meshes,
+               const Textures &textures) {
+  const int resolutions[][2] = {
+      {320, 240}, {640, 480}, {1280, 720}, {1920, 1080}};
+  vector<unsigned int> threadCounts;
+  const unsigned int cores = max(1u, thread::hardware_concurrency());
+  for (unsigned int threads = 1; threads < cores; threads *= 2) {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(cores);
+
+  cout << "Frames per second, " << cores << " cores\n"
+       << "resolution";
+  for (unsigned int threads : threadCounts) {
+    printf("%10u", threads);
+  }
+  cout << " threads\n";
+
+  for (const auto &resolution : resolutions) {
+    printf("%4dx%-5d", resolution[0], resolution[1]);
+    for (unsigned int threads : threadCounts) {
+      software::Renderer renderer(resolution[0], resolution[1], threads);
+      drawScene(renderer, graph, meshes, textures, 0.0f); // Warm up
+
+      // At least 5 frames and half a second per measure.
+      const auto start = chrono::steady_clock::now();
+      int frames = 0;
+      double elapsed = 0.0;
+      do {
+        graph.animate(1.0f / 30.0f);
+        graph.update();
+        drawScene(renderer, graph, meshes, textures, frames / 30.0f);
+        frames++;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start)
+                      .count();
+      } while (frames < 5 || elapsed < 0.5);
+      printf("%10.1f", frames / elapsed);
+      fflush(stdout);
+    }
+    cout << "\n";
+  }
+}
+
+int main(int argc, char **argv) {
+  // Load models.
+  objl::Loader loader;
+  Meshes meshes;
+  if (!loader.LoadFile("objects/sphere.obj")) {
+    cout << "Failed to load file" << endl;
+    return 1;
+  }
+  meshes.sphere = software::Mesh(loader.LoadedVertices, loader.LoadedIndices);
+  if (!loader.LoadFile("objects/cylinder.obj")) {
+    cout << "Failed to load file" << endl;
+    return 1;
+  }
+  meshes.cylinder = software::Mesh(loader.LoadedVertices, loader.LoadedIndices);
+  meshes.floor = makeFloor(400.0f, 20);
+  const house::Mesh houseMesh = house::build(10, 10, 5, 15);
+  meshes.walls = makeMesh(houseMesh.walls);
+  meshes.roof = makeMesh(houseMesh.roof);
+
+  // Load textures.
+  Textures textures;
+  for (const char *name : textureNames) {
+    if (!textures[name].load(string("textures/") + name + ".jpg")) {
+      return 1;
+    }
+  }
+
+  scene::Graph graph;
+  if (!scene::load("scenes/lab4.scene", graph)) {
+    return 1;
+  }
+  graph.update();
+
+  if (argc > 1 && strcmp(argv[1], "--benchmark") == 0) {
+    benchmark(graph, meshes, textures);
+    return 0;
+  }
+
+  const int frames = argc > 1 ? max(1, atoi(argv[1])) : 1;
+  software::Renderer renderer(WIDTH, HEIGHT);
+  for (int i = 0; i < frames; i++) {
+    const auto start = chrono::steady_clock::now();
+    drawScene(renderer, graph, meshes, textures, i / 30.0f);
+    const double ms =
+        chrono::duration<double, milli>(chrono::steady_clock::now() - start)
+            .count();
+
+    char path[32];
+    snprintf(path, sizeof(path), "frame_%03d.ppm", i);
+    if (!renderer.write(path)) {
+      return 1;
+    }
+    cout << "Wrote " << path << " in " << ms << " ms on "
+         << renderer.getThreads() << " threads\n";
+
+    graph.animate(1.0f / 30.0f);
+    graph.update();
+  }
+  return 0;
+}
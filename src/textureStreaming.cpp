@@ -0,0 +1,134 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "helpers/texture.hpp"
+#include <stb/stb_image.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Loads every texture this many times, to have something worth streaming.
+const int COPIES = 20;
+const char *textureFiles[] = {"textures/bark.jpg", "textures/brick.jpg",
+                              "textures/grass.jpg", "textures/leaves.jpg",
+                              "textures/roof.jpg"};
+
+GLFWwindow *initGL() {
+  // GLFW initialization
+  if (!glfwInit()) {
+    cout << "GLFW initialization failed\n";
+    glfwTerminate();
+    return nullptr;
+  }
+
+  // Hidden window, so it also runs under a software context like Mesa's
+  // llvmpipe (LIBGL_ALWAYS_SOFTWARE=1).
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+
+  GLFWwindow *window =
+      glfwCreateWindow(64, 64, "Texture streaming", nullptr, nullptr);
+  if (!window) {
+    cout << "GLFW windows creation failed failed\n";
+    glfwTerminate();
+    return nullptr;
+  }
+  glfwMakeContextCurrent(window);
+
+  // Glad initialization
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    cout << "Failed to initialize GLAD\n";
+    glfwTerminate();
+    return nullptr;
+  }
+  return window;
+}
+
+// Waits for the GPU so frame times include the uploads.
+void endFrame(GLFWwindow *window) {
+  glFinish();
+  glfwSwapBuffers(window);
+  glfwPollEvents();
+}
+
+// Reads a texture back and compares it with the decoded file.
+bool matches(unsigned int textureId, const string &path) {
+  int width, height, nrChannels;
+  unsigned char *expected =
+      stbi_load(path.data(), &width, &height, &nrChannels, 4);
+  if (!expected) {
+    return false;
+  }
+  vector<unsigned char> pixels(size_t(width) * height * 4);
+  glBindTexture(GL_TEXTURE_2D, textureId);
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  const bool same = memcmp(expected, pixels.data(), pixels.size()) == 0;
+  stbi_image_free(expected);
+  return same;
+}
+
+int main() {
+  GLFWwindow *window = initGL();
+  if (!window) {
+    return 1;
+  }
+  cout << "GL: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION)
+       << "\n";
+
+  // Synchronous loads, one texture per frame.
+  double longestSync = 0.0, lastTime = glfwGetTime();
+  for (int i = 0; i < COPIES; i++) {
+    for (const char *file : textureFiles) {
+      texture::free(texture::load(file));
+      endFrame(window);
+      const double now = glfwGetTime();
+      longestSync = max(longestSync, now - lastTime);
+      lastTime = now;
+    }
+  }
+
+  // Everything requested at once and streamed in.
+  vector<unsigned int> textures;
+  int frames = 0;
+  bool ok = true;
+  {
+    texture::Streamer streamer;
+    for (int i = 0; i < COPIES; i++) {
+      for (const char *file : textureFiles) {
+        textures.push_back(streamer.load(file));
+      }
+    }
+    const double start = glfwGetTime();
+    do {
+      streamer.update();
+      endFrame(window);
+      frames++;
+    } while (streamer.getStats().pending > 0 && glfwGetTime() - start < 60.0);
+
+    const auto stats = streamer.getStats();
+    cout << "Synchronous: longest frame " << longestSync * 1000.0 << " ms\n"
+         << "Streamed: " << stats.resident << "/" << textures.size()
+         << " textures resident in " << frames << " frames, "
+         << stats.bytesUploaded / (1024.0 * 1024.0) << " MiB, longest frame "
+         << stats.longestFrameMs << " ms (" << stats.longestUpdateMs
+         << " ms in update)" << (stats.persistent ? ", persistent" : "")
+         << (stats.fences ? ", fences" : "") << "\n";
+
+    ok = stats.resident == textures.size();
+    for (size_t i = 0; ok && i < sizeof(textureFiles) / sizeof(*textureFiles);
+         i++) {
+      ok = matches(textures[i], textureFiles[i]);
+    }
+  }
+  for (unsigned int textureId : textures) {
+    texture::free(textureId);
+  }
+  cout << (ok ? "Streamed textures match their files\n"
+              : "Streamed textures do not match their files\n");
+
+  glfwTerminate();
+  return ok ? 0 : 1;
+}